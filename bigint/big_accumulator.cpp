@@ -0,0 +1,99 @@
+#include "big_accumulator.h"
+
+#include <algorithm>
+
+big_accumulator::big_accumulator() = default;
+
+big_accumulator::big_accumulator(big_integer const &a) {
+    uint const *a_data = a.data.data();
+    data.assign(a_data, a_data + a.size());
+}
+
+big_accumulator &big_accumulator::operator+=(big_integer const &rhs) {
+    add(rhs, false);
+    return *this;
+}
+
+big_accumulator &big_accumulator::operator-=(big_integer const &rhs) {
+    add(rhs, true);
+    return *this;
+}
+
+// True when both the current value and a len-limb addend fit in size() - 1
+// limbs, so their sum cannot overflow the buffer.
+bool big_accumulator::has_room(size_t len) const {
+    size_t n = data.size();
+    if (n < len + 2) {
+        return false;
+    }
+    uint sign = (data[n - 2] >> (big_integer::log_base - 1)) ? ~0u : 0u;
+    return data[n - 1] == sign;
+}
+
+void big_accumulator::add(big_integer const &rhs, bool invert) {
+    size_t len = rhs.size();
+    if (!has_room(len)) {
+        uint fill = (!data.empty() && (data.back() >> (big_integer::log_base - 1))) ? ~0u : 0u;
+        data.resize(std::max(len, data.size()) * 3 / 2 + 2, fill);
+    }
+
+    uint flip = invert ? ~0u : 0u;
+    uint const *rhs_data = rhs.data.data();
+    uint *cur_data = data.data();
+
+    ull carry = invert;
+    for (size_t i = 0; i < len; i++) {
+        ull cur = (ull) cur_data[i] + (rhs_data[i] ^ flip) + carry;
+        cur_data[i] = (uint) cur;
+        carry = cur >> big_integer::log_base;
+    }
+
+    // Above the addend every limb receives fill + carry, which is a no-op
+    // unless it amounts to +1 or -1, and those stop propagating quickly.
+    uint fill = (rhs.negative() ? ~0u : 0u) ^ flip;
+    if (fill == 0 && carry) {
+        for (size_t i = len; i < data.size() && ++cur_data[i] == 0; i++) {
+        }
+    } else if (fill != 0 && !carry) {
+        for (size_t i = len; i < data.size() && cur_data[i]-- == 0; i++) {
+        }
+    }
+}
+
+big_integer big_accumulator::value() const {
+    big_integer res;
+    if (!data.empty()) {
+        res.data.resize((uint) data.size());
+        std::copy(data.begin(), data.end(), res.data.data());
+        res.shrink();
+    }
+    return res;
+}
+
+bool operator==(big_accumulator const &a, big_integer const &b) {
+    return a.value() == b;
+}
+
+bool operator!=(big_accumulator const &a, big_integer const &b) {
+    return a.value() != b;
+}
+
+bool operator<(big_accumulator const &a, big_integer const &b) {
+    return a.value() < b;
+}
+
+bool operator>(big_accumulator const &a, big_integer const &b) {
+    return a.value() > b;
+}
+
+bool operator<=(big_accumulator const &a, big_integer const &b) {
+    return a.value() <= b;
+}
+
+bool operator>=(big_accumulator const &a, big_integer const &b) {
+    return a.value() >= b;
+}
+
+std::ostream &operator<<(std::ostream &s, big_accumulator const &a) {
+    return s << a.value();
+}
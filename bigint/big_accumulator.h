@@ -0,0 +1,56 @@
+#ifndef BIGINT_BIG_ACCUMULATOR_H
+#define BIGINT_BIG_ACCUMULATOR_H
+
+#include <vector>
+#include "big_integer.h"
+
+// Running sum of big_integers. Limbs are kept in two's complement with spare
+// room on top and are never shrunk; normalisation happens only when the value
+// is read out or compared.
+class big_accumulator {
+public:
+    big_accumulator();
+
+    big_accumulator(big_integer const &a);
+
+    big_accumulator &operator+=(big_integer const &rhs);
+
+    big_accumulator &operator-=(big_integer const &rhs);
+
+    big_integer value() const;
+
+    friend bool operator==(big_accumulator const &a, big_integer const &b);
+
+    friend bool operator!=(big_accumulator const &a, big_integer const &b);
+
+    friend bool operator<(big_accumulator const &a, big_integer const &b);
+
+    friend bool operator>(big_accumulator const &a, big_integer const &b);
+
+    friend bool operator<=(big_accumulator const &a, big_integer const &b);
+
+    friend bool operator>=(big_accumulator const &a, big_integer const &b);
+
+private:
+    std::vector<uint> data;
+
+    void add(big_integer const &rhs, bool invert);
+
+    bool has_room(size_t len) const;
+};
+
+bool operator==(big_accumulator const &a, big_integer const &b);
+
+bool operator!=(big_accumulator const &a, big_integer const &b);
+
+bool operator<(big_accumulator const &a, big_integer const &b);
+
+bool operator>(big_accumulator const &a, big_integer const &b);
+
+bool operator<=(big_accumulator const &a, big_integer const &b);
+
+bool operator>=(big_accumulator const &a, big_integer const &b);
+
+std::ostream &operator<<(std::ostream &s, big_accumulator const &a);
+
+#endif //BIGINT_BIG_ACCUMULATOR_H
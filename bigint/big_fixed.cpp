@@ -0,0 +1,58 @@
+#include "big_fixed.h"
+
+#include <stdexcept>
+
+big_integer divide_rounded(big_integer const &num, big_integer const &den, rounding mode) {
+    if (den == 0) {
+        throw std::domain_error("divide_rounded: division by zero");
+    }
+    big_integer q = num / den;
+    big_integer r = num - q * den;
+    if (r == 0) {
+        return q;
+    }
+
+    // q is truncated toward zero; the exact quotient lies between q and q + step
+    bool negative = (num < 0) != (den < 0);
+    int step = negative ? -1 : 1;
+    big_integer twice = (r < 0 ? -r : r) << 1;
+    big_integer divisor = den < 0 ? -den : den;
+
+    // No default: -Wswitch then flags a rounding mode left out here
+    bool away = false;
+    switch (mode) {
+        case rounding::toward_zero:
+            away = false;
+            break;
+        case rounding::away_from_zero:
+            away = true;
+            break;
+        case rounding::floor:
+            away = negative;
+            break;
+        case rounding::ceiling:
+            away = !negative;
+            break;
+        case rounding::half_away_from_zero:
+            away = twice >= divisor;
+            break;
+        case rounding::half_even:
+            away = twice > divisor || (twice == divisor && (q & 1) != 0);
+            break;
+    }
+    if (away) {
+        q += step;
+    }
+    return q;
+}
+
+big_integer power_of_ten(unsigned exponent) {
+    big_integer res = 1, base = 10;
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1) {
+            res *= base;
+        }
+        base *= base;
+    }
+    return res;
+}
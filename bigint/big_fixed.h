@@ -0,0 +1,159 @@
+#ifndef BIGINT_BIG_FIXED_H
+#define BIGINT_BIG_FIXED_H
+
+#include <string>
+#include "big_integer.h"
+#include "big_rational.h"
+
+enum class rounding {
+    toward_zero,
+    away_from_zero,
+    floor,
+    ceiling,
+    half_away_from_zero,
+    half_even
+};
+
+// num / den rounded to an integer; throws std::domain_error if den is zero
+big_integer divide_rounded(big_integer const &num, big_integer const &den, rounding mode);
+
+big_integer power_of_ten(unsigned exponent);
+
+// Decimal fixed-point number stored as an integer count of 10^-Scale units.
+// Addition and subtraction are exact; multiplication, division and conversions
+// round with Mode.
+template<unsigned Scale, rounding Mode = rounding::half_even>
+class big_fixed {
+public:
+    big_fixed() = default;
+
+    big_fixed(int a) : raw(big_integer(a) * unit()) {}
+
+    big_fixed(big_integer const &a) : raw(a * unit()) {}
+
+    explicit big_fixed(big_rational const &a)
+            : raw(divide_rounded(a.numerator() * unit(), a.denominator(), Mode)) {}
+
+    // Accepts "[-]digits[.digits]"; extra fractional digits are rounded
+    explicit big_fixed(std::string const &str) {
+        size_t dot = str.find('.');
+        std::string digits = str.substr(0, dot);
+        std::string fraction = (dot == std::string::npos) ? "" : str.substr(dot + 1);
+        if (fraction.size() <= Scale) {
+            raw = big_integer(digits + fraction + std::string(Scale - fraction.size(), '0'));
+        } else {
+            raw = divide_rounded(big_integer(digits + fraction), power_of_ten(fraction.size() - Scale), Mode);
+        }
+    }
+
+    static big_fixed from_raw(big_integer raw) {
+        big_fixed res;
+        res.raw = std::move(raw);
+        return res;
+    }
+
+    big_integer const &raw_value() const {
+        return raw;
+    }
+
+    static big_integer const &unit() {
+        static const big_integer res = power_of_ten(Scale);
+        return res;
+    }
+
+    big_fixed &operator+=(big_fixed const &rhs) {
+        raw += rhs.raw;
+        return *this;
+    }
+
+    big_fixed &operator-=(big_fixed const &rhs) {
+        raw -= rhs.raw;
+        return *this;
+    }
+
+    big_fixed &operator*=(big_fixed const &rhs) {
+        raw = divide_rounded(raw * rhs.raw, unit(), Mode);
+        return *this;
+    }
+
+    big_fixed &operator/=(big_fixed const &rhs) {
+        raw = divide_rounded(raw * unit(), rhs.raw, Mode);
+        return *this;
+    }
+
+    big_fixed operator+() const {
+        return *this;
+    }
+
+    big_fixed operator-() const {
+        return from_raw(-raw);
+    }
+
+    big_rational to_rational() const {
+        return big_rational(raw, unit());
+    }
+
+    friend bool operator==(big_fixed const &a, big_fixed const &b) {
+        return a.raw == b.raw;
+    }
+
+    friend bool operator!=(big_fixed const &a, big_fixed const &b) {
+        return a.raw != b.raw;
+    }
+
+    friend bool operator<(big_fixed const &a, big_fixed const &b) {
+        return a.raw < b.raw;
+    }
+
+    friend bool operator>(big_fixed const &a, big_fixed const &b) {
+        return a.raw > b.raw;
+    }
+
+    friend bool operator<=(big_fixed const &a, big_fixed const &b) {
+        return a.raw <= b.raw;
+    }
+
+    friend bool operator>=(big_fixed const &a, big_fixed const &b) {
+        return a.raw >= b.raw;
+    }
+
+    friend big_fixed operator+(big_fixed a, big_fixed const &b) {
+        a += b;
+        return a;
+    }
+
+    friend big_fixed operator-(big_fixed a, big_fixed const &b) {
+        a -= b;
+        return a;
+    }
+
+    friend big_fixed operator*(big_fixed a, big_fixed const &b) {
+        a *= b;
+        return a;
+    }
+
+    friend big_fixed operator/(big_fixed a, big_fixed const &b) {
+        a /= b;
+        return a;
+    }
+
+    friend std::string to_string(big_fixed const &a) {
+        std::string digits = to_string(a.raw < 0 ? -a.raw : a.raw);
+        if (digits.size() <= Scale) {
+            digits.insert(0, Scale + 1 - digits.size(), '0');
+        }
+        if (Scale > 0) {
+            digits.insert(digits.size() - Scale, ".");
+        }
+        return (a.raw < 0 ? "-" : "") + digits;
+    }
+
+    friend std::ostream &operator<<(std::ostream &s, big_fixed const &a) {
+        return s << to_string(a);
+    }
+
+private:
+    big_integer raw;
+};
+
+#endif //BIGINT_BIG_FIXED_H
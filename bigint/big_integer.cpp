@@ -1,6 +1,9 @@
 #include "big_integer.h"
+#include "limb_kernels.h"
 
 #include <cstring>
+#include <ostream>
+#include <stdexcept>
 #include <vector>
 
 const uint big_integer::log_base = 32;
@@ -11,17 +14,25 @@ bool big_integer::negative() const {
     return !data.empty() && (data.back() & ((uint) 1 << (log_base - 1)));
 }
 
-bool big_integer::negative_last() const {
-    return data.size() > 1 && (data[data.size() - 2] & ((uint) 1 << (log_base - 1)));
-}
-
 uint big_integer::null_value() const {
     return negative() ? base - 1 : 0;
 }
 
 void big_integer::shrink() {
-    while (!data.empty() && data.back() == null_value() && negative() == negative_last()) {
-        data.pop_back();
+    my_vector const &digits = data;
+    uint const *d = digits.data();
+    size_t len = digits.size();
+    uint sign_bit = (uint) 1 << (log_base - 1);
+    while (len > 0) {
+        uint fill = (d[len - 1] & sign_bit) ? base - 1 : 0;
+        uint below = (len > 1) ? (d[len - 2] & sign_bit) : 0;
+        if (d[len - 1] != fill || (fill & sign_bit) != below) {
+            break;
+        }
+        len--;
+    }
+    if (len < digits.size()) {
+        data.resize((uint) len);
     }
 }
 
@@ -58,50 +69,87 @@ big_integer::big_integer(std::string const &str) {
     }
 }
 
+big_integer::big_integer(big_integer &&other) noexcept = default;
+
 big_integer::~big_integer() = default;
 
 big_integer &big_integer::operator=(big_integer const &other) = default;
 
+big_integer &big_integer::operator=(big_integer &&other) noexcept = default;
+
+namespace {
+    // Above the shorter operand each limb gets its sign fill plus the carry,
+    // which is either a no-op or a +1 / -1 that stops at the first limb it
+    // does not wrap.
+    void increment(uint *d, size_t from, size_t len) {
+        for (size_t i = from; i < len && ++d[i] == 0; i++) {
+        }
+    }
+
+    void decrement(uint *d, size_t from, size_t len) {
+        for (size_t i = from; i < len && d[i]-- == 0; i++) {
+        }
+    }
+}
+
 big_integer &big_integer::operator+=(big_integer const &rhs) {
-    size_t len = std::max(size(), rhs.size()) + 2;
-    data.resize(len, null_value());
+    if (this == &rhs) {
+        return *this <<= 1;
+    }
+    size_t n = rhs.size();
+    bool rhs_negative = rhs.negative();
+    data.resize(std::max(size(), n) + 1, null_value());
 
     uint* cur_data = data.data();
-    const uint* rhs_data = rhs.data.data();
-
-    bool carry = false;
-    for (size_t i = 0; i < len; i++) {
-        uint digit = i < rhs.size() ? rhs_data[i] : rhs.null_value();
-        bool ncarry = ((ull) cur_data[i] + digit + carry) >= base;
-        cur_data[i] += digit + carry;
-        carry = ncarry;
+    uint carry = kernels().add_n(cur_data, cur_data, rhs.data.data(), n);
+    if (!rhs_negative && carry) {
+        increment(cur_data, n, size());
+    } else if (rhs_negative && !carry) {
+        decrement(cur_data, n, size());
     }
     shrink();
     return *this;
 }
 
 big_integer &big_integer::operator-=(big_integer const &rhs) {
-    return operator+=(-rhs);
+    if (this == &rhs) {
+        return *this = 0;
+    }
+    size_t n = rhs.size();
+    bool rhs_negative = rhs.negative();
+    data.resize(std::max(size(), n) + 1, null_value());
+
+    uint* cur_data = data.data();
+    uint borrow = kernels().sub_n(cur_data, cur_data, rhs.data.data(), n);
+    if (!rhs_negative && borrow) {
+        decrement(cur_data, n, size());
+    } else if (rhs_negative && !borrow) {
+        increment(cur_data, n, size());
+    }
+    shrink();
+    return *this;
 }
 
 big_integer &big_integer::operator*=(big_integer const &rhs) {
+    bool neg = negative() ^ rhs.negative();
+    big_integer a = negative() ? -*this : *this;
+    big_integer b = rhs.negative() ? -rhs : rhs;
+    my_vector const &a_data = a.data, &b_data = b.data;
+    size_t n = a.size(), m = b.size();
+
     big_integer res;
-    big_integer a = *this, b = rhs;
-    if (a.negative()) {
-        a = -a;
-    }
-    if (b.negative()) {
-        b = -b;
-    }
-    uint* const b_data = b.data.data();
-    for (size_t i = 0; i < b.size(); i++) {
-        res += (a * b_data[i]) << (i * log_base);
+    if (n && m) {
+        res.data.resize((uint) (n + m + 1));
+        uint* res_data = res.data.data();
+        for (size_t i = 0; i < m; i++) {
+            res_data[i + n] = kernels().addmul_1(res_data + i, a_data.data(), n, b_data[i]);
+        }
+        res.shrink();
     }
-    if (negative() ^ rhs.negative()) {
+    if (neg) {
         res = -res;
     }
-    res.shrink();
-    return *this = res;
+    return *this = std::move(res);
 }
 
 big_integer &big_integer::operator/=(big_integer const &rhs) {
@@ -202,12 +250,8 @@ big_integer &big_integer::operator<<=(int rhs) {
     uint shift = rhs - blocks * log_base;
     if (shift) {
         data.push_back(null_value());
-        for (size_t i = size(); i > 0; i--) {
-            if (i < size()) {
-                data[i] += data[i - 1] >> (log_base - shift);
-            }
-            data[i - 1] <<= shift;
-        }
+        uint* cur_data = data.data();
+        kernels().lshift(cur_data, cur_data, size(), shift);
     }
     shrink();
     return *this;
@@ -222,15 +266,11 @@ big_integer &big_integer::operator>>=(int rhs) {
         shift(-blocks);
     }
     uint shift = rhs - blocks * log_base;
-    if (shift) {
+    if (shift && size() > 0) {
         uint cur = null_value();
-        for (size_t i = 0; i < size(); i++) {
-            if (i > 0) {
-                data[i - 1] += data[i] << (log_base - shift);
-            }
-            data[i] >>= shift;
-        }
-        data.back() += cur << (log_base - shift);
+        uint* cur_data = data.data();
+        kernels().rshift(cur_data, cur_data, size(), shift);
+        cur_data[size() - 1] |= cur << (log_base - shift);
     }
     shrink();
     return *this;
@@ -278,43 +318,53 @@ const big_integer big_integer::operator--(int) {
 }
 
 big_integer operator+(big_integer a, big_integer const &b) {
-    return a += b;
+    a += b;
+    return a;
 }
 
 big_integer operator-(big_integer a, big_integer const &b) {
-    return a -= b;
+    a -= b;
+    return a;
 }
 
 big_integer operator*(big_integer a, big_integer const &b) {
-    return a *= b;
+    a *= b;
+    return a;
 }
 
 big_integer operator/(big_integer a, big_integer const &b) {
-    return a /= b;
+    a /= b;
+    return a;
 }
 
 big_integer operator%(big_integer a, big_integer const &b) {
-    return a %= b;
+    a %= b;
+    return a;
 }
 
 big_integer operator&(big_integer a, big_integer const &b) {
-    return a &= b;
+    a &= b;
+    return a;
 }
 
 big_integer operator|(big_integer a, big_integer const &b) {
-    return a |= b;
+    a |= b;
+    return a;
 }
 
 big_integer operator^(big_integer a, big_integer const &b) {
-    return a ^= b;
+    a ^= b;
+    return a;
 }
 
 big_integer operator<<(big_integer a, int b) {
-    return a <<= b;
+    a <<= b;
+    return a;
 }
 
 big_integer operator>>(big_integer a, int b) {
-    return a >>= b;
+    a >>= b;
+    return a;
 }
 
 bool operator==(big_integer const &a, big_integer const &b) {
@@ -359,15 +409,10 @@ big_integer operator*(big_integer const &a, uint const &b) {
         res = -res;
     }
     res.data.push_back(0);
-    uint carry = 0;
 
     uint* res_data = res.data.data();
-
-    for (size_t i = 0; i < res.size(); i++) {
-        ull cur = (ull) res_data[i] * b + carry;
-        res_data[i] = (uint) (cur & (big_integer::base - 1));
-        carry = (uint) (cur >> big_integer::log_base);
-    }
+    size_t n = res.size() - 1;
+    res_data[n] = kernels().mul_1(res_data, res_data, n, b);
     if (neg) {
         res = -res;
     }
@@ -415,6 +460,182 @@ std::string to_string(big_integer const &a) {
     return res;
 }
 
+namespace {
+    // Spreads the nibbles of a limb into bytes and turns them into ASCII
+    // eight at a time, most significant digit first.
+    void limb_to_hex(uint x, char *out) {
+        ull v = x;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        ull letters = ((v + 0x0606060606060606ull) >> 4) & 0x0101010101010101ull;
+        v += 0x3030303030303030ull + letters * ('a' - '0' - 10);
+        for (int i = 0; i < 8; i++) {
+            out[7 - i] = (char) (v >> (8 * i));
+        }
+    }
+
+    int hex_digit(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+}
+
+std::string to_hex_string(big_integer const &a) {
+    big_integer tmp = a.negative() ? -a : a;
+    uint const *d = tmp.data.data();
+    size_t len = tmp.size();
+    while (len > 0 && d[len - 1] == 0) {
+        len--;
+    }
+    if (len == 0) {
+        return "0";
+    }
+
+    char top[8];
+    limb_to_hex(d[len - 1], top);
+    size_t skip = 0;
+    while (top[skip] == '0') {
+        skip++;
+    }
+
+    std::string res(a.negative() ? "-" : "");
+    size_t offset = res.size();
+    res.resize(offset + (8 - skip) + 8 * (len - 1));
+    memcpy(&res[offset], top + skip, 8 - skip);
+    offset += 8 - skip;
+    for (size_t i = len - 1; i > 0; i--, offset += 8) {
+        limb_to_hex(d[i - 1], &res[offset]);
+    }
+    return res;
+}
+
+big_integer from_hex(std::string const &str) {
+    size_t pos = 0;
+    bool neg = false;
+    if (pos < str.size() && (str[pos] == '-' || str[pos] == '+')) {
+        neg = (str[pos++] == '-');
+    }
+    if (pos + 1 < str.size() && str[pos] == '0' && (str[pos + 1] == 'x' || str[pos + 1] == 'X')) {
+        pos += 2;
+    }
+    if (pos == str.size()) {
+        throw std::invalid_argument("from_hex: no digits");
+    }
+
+    size_t digits = str.size() - pos;
+    size_t len = (digits + 7) / 8;
+    big_integer res;
+    res.data.resize((uint) len + 1);
+    uint *res_data = res.data.data();
+    res_data[len] = 0;
+    for (size_t i = 0; i < len; i++) {
+        size_t end = str.size() - 8 * i;
+        size_t begin = (end - pos > 8) ? end - 8 : pos;
+        uint limb = 0;
+        for (size_t j = begin; j < end; j++) {
+            int digit = hex_digit(str[j]);
+            if (digit < 0) {
+                throw std::invalid_argument("from_hex: invalid digit");
+            }
+            limb = (limb << 4) | (uint) digit;
+        }
+        res_data[i] = limb;
+    }
+    res.shrink();
+    return neg ? -res : res;
+}
+
+size_t bit_length(big_integer const &a) {
+    big_integer tmp = a.negative() ? -a : a;
+    uint const *d = tmp.data.data();
+    size_t len = tmp.size();
+    while (len > 0 && d[len - 1] == 0) {
+        len--;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    size_t bits = (len - 1) * big_integer::log_base;
+    for (uint top = d[len - 1]; top; top >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+namespace {
+    // Bits [shift, shift + 32) of a non-negative a
+    ull window(uint const *d, size_t len, size_t shift) {
+        size_t i = shift / 32, offset = shift % 32;
+        ull res = i < len ? d[i] >> offset : 0;
+        if (offset && i + 1 < len) {
+            res |= (ull) d[i + 1] << (32 - offset);
+        }
+        return res & 0xFFFFFFFFull;
+    }
+
+    big_integer mul_signed(big_integer const &a, long long k) {
+        return k < 0 ? -(a * (uint) -k) : a * (uint) k;
+    }
+}
+
+big_integer gcd(big_integer const &x, big_integer const &y) {
+    big_integer a = x.negative() ? -x : x;
+    big_integer b = y.negative() ? -y : y;
+    if (a < b) {
+        std::swap(a, b);
+    }
+
+    // Lehmer: run Euclid on the leading 32 bits and apply the accumulated
+    // cosequence to the full numbers, one multi-precision step per ~32 bits
+    while (bit_length(b) > big_integer::log_base) {
+        size_t shift = bit_length(a) - big_integer::log_base;
+        long long ah = (long long) window(a.data.data(), a.size(), shift);
+        long long bh = (long long) window(b.data.data(), b.size(), shift);
+        long long A = 1, B = 0, C = 0, D = 1;
+        while (bh + C > 0 && bh + D > 0) {
+            long long q = (ah + A) / (bh + C);
+            if (q != (ah + B) / (bh + D)) {
+                break;
+            }
+            long long t = A - q * C;
+            A = C, C = t;
+            t = B - q * D;
+            B = D, D = t;
+            t = ah - q * bh;
+            ah = bh, bh = t;
+        }
+        if (B == 0) {
+            big_integer t = a % b;
+            a = std::move(b);
+            b = std::move(t);
+        } else {
+            big_integer t = mul_signed(a, A) + mul_signed(b, B);
+            b = mul_signed(a, C) + mul_signed(b, D);
+            a = std::move(t);
+        }
+    }
+
+    if (b == 0) {
+        return a;
+    }
+    ull u = b.data.data()[0], v = my_div(a, (uint) u).second;
+    while (v) {
+        ull t = u % v;
+        u = v;
+        v = t;
+    }
+    return big_integer((uint) u);
+}
+
 size_t big_integer::size() const {
     return data.size();
 }
@@ -428,5 +649,23 @@ uint big_integer::trial(uint const &a, uint const &b, uint const &c) const {
 }
 
 std::ostream &operator<<(std::ostream &s, big_integer const &a) {
-    return s << to_string(a);
+    if ((s.flags() & std::ios_base::basefield) != std::ios_base::hex) {
+        return s << to_string(a);
+    }
+    std::string res = to_hex_string(a);
+    if (s.flags() & std::ios_base::uppercase) {
+        for (char &c : res) {
+            if (c >= 'a' && c <= 'f') {
+                c += 'A' - 'a';
+            }
+        }
+    }
+    if (s.flags() & std::ios_base::showbase) {
+        res.insert(res[0] == '-' ? 1 : 0, (s.flags() & std::ios_base::uppercase) ? "0X" : "0x");
+    }
+    return s << res;
+}
+
+size_t std::hash<big_integer>::operator()(big_integer const &a) const {
+    return a.data.hash();
 }
@@ -3,12 +3,21 @@
 
 #include <string>
 #include <functional>
+#include <random>
+#include <vector>
 #include "my_vector.h"
 
 
 typedef uint32_t uint;
 typedef uint64_t ull;
 
+struct big_integer;
+
+namespace std {
+    template<>
+    struct hash<big_integer>;
+}
+
 struct big_integer {
 private:
     my_vector data;
@@ -19,8 +28,6 @@ private:
 
     bool negative() const;
 
-    bool negative_last() const;
-
     void shrink();
 
     uint null_value() const;
@@ -36,6 +43,8 @@ public:
 
     big_integer(big_integer const &other);
 
+    big_integer(big_integer &&other) noexcept;
+
     big_integer(int a);
 
     big_integer(uint a);
@@ -46,6 +55,8 @@ public:
 
     big_integer &operator=(big_integer const &other);
 
+    big_integer &operator=(big_integer &&other) noexcept;
+
     big_integer &operator+=(big_integer const &rhs);
 
     big_integer &operator-=(big_integer const &rhs);
@@ -100,6 +111,29 @@ public:
 
     friend std::string to_string(big_integer const &a);
 
+    friend std::string to_hex_string(big_integer const &a);
+
+    friend size_t bit_length(big_integer const &a);
+
+    friend big_integer gcd(big_integer const &a, big_integer const &b);
+
+    friend big_integer from_hex(std::string const &str);
+
+    friend bool is_probable_prime(big_integer const &n);
+
+    friend big_integer next_prime(big_integer const &n);
+
+    friend class montgomery;
+
+    friend class big_accumulator;
+
+    friend struct std::hash<big_integer>;
+
+    template<class URBG>
+    friend big_integer random_bits(URBG &engine, size_t bits);
+
+    template<class URBG>
+    friend big_integer random_below(URBG &engine, big_integer const &bound);
 };
 
 big_integer operator+(big_integer a, big_integer const &b);
@@ -140,6 +174,96 @@ big_integer operator*(big_integer const &a, uint const &b);
 
 std::string to_string(big_integer const &a);
 
+// Number of bits in |a|
+size_t bit_length(big_integer const &a);
+
+// Greatest common divisor of |a| and |b| by Lehmer's algorithm
+big_integer gcd(big_integer const &a, big_integer const &b);
+
+// Lowercase hexadecimal without prefix, e.g. "-1f"; linear in the length
+std::string to_hex_string(big_integer const &a);
+
+// Accepts an optional sign and "0x" prefix; throws std::invalid_argument
+big_integer from_hex(std::string const &str);
+
+// Honours std::hex, std::uppercase and std::showbase
 std::ostream &operator<<(std::ostream &s, big_integer const &a);
 
+// Baillie-PSW: trial division, strong base-2 Miller-Rabin, strong Lucas
+bool is_probable_prime(big_integer const &n);
+
+// Tests every candidate on up to `threads` threads (0 means all cores)
+std::vector<bool> is_probable_prime(std::vector<big_integer> const &candidates, unsigned threads = 0);
+
+// Smallest probable prime strictly greater than n
+big_integer next_prime(big_integer const &n);
+
+// Uniform in [0, 2^bits), limbs are filled straight from the engine
+template<class URBG>
+big_integer random_bits(URBG &engine, size_t bits) {
+    std::uniform_int_distribution<uint> limb;
+    size_t len = (bits + big_integer::log_base - 1) / big_integer::log_base;
+
+    big_integer res;
+    res.data.resize((uint) len + 1);
+    uint *res_data = res.data.data();
+    for (size_t i = 0; i < len; i++) {
+        res_data[i] = limb(engine);
+    }
+    if (bits % big_integer::log_base) {
+        res_data[len - 1] &= ((uint) 1 << (bits % big_integer::log_base)) - 1;
+    }
+    res_data[len] = 0;
+    res.shrink();
+    return res;
+}
+
+// Uniform in [0, bound) for a positive bound. Limbs are drawn from the top and
+// compared against bound as they go, so a rejection only discards the prefix
+// that already exceeds it and the remaining limbs are drawn exactly once.
+template<class URBG>
+big_integer random_below(URBG &engine, big_integer const &bound) {
+    std::uniform_int_distribution<uint> limb;
+    uint const *bound_data = bound.data.data();
+    size_t len = bound.size();
+    while (len > 0 && bound_data[len - 1] == 0) {
+        len--;
+    }
+
+    big_integer res;
+    if (len == 0 || bound.negative()) {
+        return res;
+    }
+    res.data.resize((uint) len + 1);
+    uint *res_data = res.data.data();
+    res_data[len] = 0;
+
+    std::uniform_int_distribution<uint> top(0, bound_data[len - 1]);
+    size_t i = len;
+    while (i > 0) {
+        res_data[i - 1] = (i == len ? top(engine) : limb(engine));
+        if (res_data[i - 1] < bound_data[i - 1]) {
+            break;
+        }
+        if (res_data[i - 1] > bound_data[i - 1] || i == 1) {
+            i = len;
+        } else {
+            i--;
+        }
+    }
+    for (size_t j = i - 1; j > 0; j--) {
+        res_data[j - 1] = limb(engine);
+    }
+    res.shrink();
+    return res;
+}
+
+namespace std {
+    // Hashes the normalised limbs; blocks shared between copies cache the result
+    template<>
+    struct hash<big_integer> {
+        size_t operator()(big_integer const &a) const;
+    };
+}
+
 #endif // BIG_INTEGER_H
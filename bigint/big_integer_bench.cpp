@@ -0,0 +1,165 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "big_integer.h"
+
+// Usage: bigint_bench [--max-limbs N] [--max-quadratic-limbs N] [--min-time-ms N] [--json FILE]
+//
+// Every operation is timed for operand sizes 1, 4, 16, ... limbs. Operations
+// that are quadratic in this implementation (mul, div, mod, to_string and
+// parsing) stop at --max-quadratic-limbs so a run finishes in reasonable time.
+
+namespace {
+    size_t allocations = 0;
+
+    struct result {
+        std::string op;
+        size_t limbs;
+        size_t iterations;
+        double ns_per_op;
+        double limbs_per_sec;
+        double allocs_per_op;
+    };
+
+    big_integer sink;
+
+    big_integer operand(std::mt19937 &engine, size_t limbs) {
+        big_integer a = random_bits(engine, limbs * 32 - 1);
+        return (engine() % 2) ? -a : a;
+    }
+
+    template<class F>
+    result measure(std::string const &op, size_t limbs, double min_time_ms, F const &f) {
+        typedef std::chrono::steady_clock clock;
+        size_t iterations = 0;
+        size_t allocs_before = allocations;
+        clock::time_point start = clock::now();
+        double elapsed_ns = 0;
+        for (size_t batch = 1; elapsed_ns < min_time_ms * 1e6; batch *= 2) {
+            for (size_t i = 0; i < batch; i++) {
+                f();
+            }
+            iterations += batch;
+            elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        }
+
+        result r;
+        r.op = op;
+        r.limbs = limbs;
+        r.iterations = iterations;
+        r.ns_per_op = elapsed_ns / iterations;
+        r.limbs_per_sec = limbs * 1e9 / r.ns_per_op;
+        r.allocs_per_op = (double) (allocations - allocs_before) / iterations;
+        return r;
+    }
+
+    void print(result const &r) {
+        std::printf("%-10s %8zu limbs %14.1f ns/op %14.3e limbs/s %8.2f allocs/op\n",
+                    r.op.c_str(), r.limbs, r.ns_per_op, r.limbs_per_sec, r.allocs_per_op);
+        std::fflush(stdout);
+    }
+
+    // False if the file could not be written
+    bool write_json(std::string const &path, std::vector<result> const &results) {
+        std::ofstream out(path);
+        out << "{\n  \"benchmark\": \"bigint_bench\",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            result const &r = results[i];
+            out << "    {\"op\": \"" << r.op << "\", \"limbs\": " << r.limbs
+                << ", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << r.ns_per_op
+                << ", \"limbs_per_sec\": " << r.limbs_per_sec
+                << ", \"allocs_per_op\": " << r.allocs_per_op << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        out.close();
+        return !out.fail();
+    }
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_limbs = 1 << 20;
+    size_t max_quadratic_limbs = 1 << 10;
+    double min_time_ms = 100;
+    std::string json = "bigint_bench.json";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--max-limbs") {
+            max_limbs = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (option == "--max-quadratic-limbs") {
+            max_quadratic_limbs = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (option == "--min-time-ms") {
+            min_time_ms = std::atof(argv[i + 1]);
+        } else if (option == "--json") {
+            json = argv[i + 1];
+        } else {
+            std::cerr << "Usage: <bigint_bench> [--max-limbs N] [--max-quadratic-limbs N] "
+                         "[--min-time-ms N] [--json FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 engine(1);
+    std::vector<result> results;
+    auto run = [&](std::string const &op, size_t limbs, std::function<void()> const &f) {
+        results.push_back(measure(op, limbs, min_time_ms, f));
+        print(results.back());
+    };
+
+    for (size_t limbs = 1; limbs <= max_limbs; limbs *= 4) {
+        big_integer a = operand(engine, limbs), b = operand(engine, limbs);
+        int bits = (int) (limbs * 16 + 7);
+
+        run("add", limbs, [&] { sink = a + b; });
+        run("sub", limbs, [&] { sink = a - b; });
+        run("shl", limbs, [&] { sink = a << bits; });
+        run("shr", limbs, [&] { sink = a >> bits; });
+        run("and", limbs, [&] { sink = a & b; });
+        run("or", limbs, [&] { sink = a | b; });
+        run("xor", limbs, [&] { sink = a ^ b; });
+
+        if (limbs > max_quadratic_limbs) {
+            continue;
+        }
+        big_integer d = operand(engine, (limbs + 1) / 2);
+        std::string str = to_string(a);
+
+        run("mul", limbs, [&] { sink = a * b; });
+        run("div", limbs, [&] { sink = a / d; });
+        run("mod", limbs, [&] { sink = a % d; });
+        run("to_string", limbs, [&] { sink = (int) to_string(a).size(); });
+        run("parse", limbs, [&] { sink = big_integer(str); });
+    }
+
+    if (!write_json(json, results)) {
+        std::cerr << "Cannot write " << json << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include "big_integer.h"
+#include "montgomery.h"
+
+#include <atomic>
+#include <thread>
+
+namespace {
+    const uint sieve_limit = 1024;
+
+    std::vector<bool> const &sieve() {
+        static const std::vector<bool> composite = [] {
+            std::vector<bool> res(sieve_limit, false);
+            res[0] = res[1] = true;
+            for (uint i = 2; i * i < sieve_limit; i++) {
+                if (!res[i]) {
+                    for (uint j = i * i; j < sieve_limit; j += i) {
+                        res[j] = true;
+                    }
+                }
+            }
+            return res;
+        }();
+        return composite;
+    }
+
+    std::vector<uint> const &small_primes() {
+        static const std::vector<uint> primes = [] {
+            std::vector<uint> res;
+            for (uint i = 2; i < sieve_limit; i++) {
+                if (!sieve()[i]) {
+                    res.push_back(i);
+                }
+            }
+            return res;
+        }();
+        return primes;
+    }
+
+    uint mod_small(uint const *a, size_t len, uint p) {
+        ull res = 0;
+        for (size_t i = len; i > 0; i--) {
+            res = ((res << 32) | a[i - 1]) % p;
+        }
+        return (uint) res;
+    }
+
+    // Jacobi symbol (a/n) for odd n
+    int jacobi(uint a, uint n) {
+        int res = 1;
+        a %= n;
+        while (a) {
+            while (a % 2 == 0) {
+                a /= 2;
+                if (n % 8 == 3 || n % 8 == 5) {
+                    res = -res;
+                }
+            }
+            std::swap(a, n);
+            if (a % 4 == 3 && n % 4 == 3) {
+                res = -res;
+            }
+            a %= n;
+        }
+        return n == 1 ? res : 0;
+    }
+
+    // Jacobi symbol (d/n) for a small signed d and a big odd n > |d|
+    int jacobi(int d, uint const *n, size_t len) {
+        int res = 1;
+        uint a = (uint) (d < 0 ? -d : d);
+        if (d < 0 && n[0] % 4 == 3) {
+            res = -res;
+        }
+        while (a % 2 == 0) {
+            a /= 2;
+            if (n[0] % 8 == 3 || n[0] % 8 == 5) {
+                res = -res;
+            }
+        }
+        if (a == 1) {
+            return res;
+        }
+        if (a % 4 == 3 && n[0] % 4 == 3) {
+            res = -res;
+        }
+        return res * jacobi(mod_small(n, len, a), a);
+    }
+
+    bool is_square(big_integer const &n, uint const *n_data, size_t len) {
+        static const uint residues[] = {64, 63, 65, 11};
+        for (uint m : residues) {
+            uint r = mod_small(n_data, len, m);
+            bool square = false;
+            for (uint x = 0; x < m && !square; x++) {
+                square = (x * x % m == r);
+            }
+            if (!square) {
+                return false;
+            }
+        }
+        big_integer x = big_integer(1) << (int) ((bit_length(n) + 1) / 2);
+        while (true) {
+            big_integer y = (x + n / x) >> 1;
+            if (y >= x) {
+                break;
+            }
+            x = y;
+        }
+        return x * x == n;
+    }
+
+    bool strong_probable_prime(montgomery &m, big_integer const &n) {
+        big_integer d = n - 1;
+        size_t s = 0;
+        while (!montgomery::test_bit(d, s)) {
+            s++;
+        }
+        d >>= (int) s;
+
+        montgomery::residue minus_one = m.zero();
+        m.sub(minus_one, m.one());
+
+        montgomery::residue x = m.pow(m.convert(2), d);
+        if (x == m.one() || x == minus_one) {
+            return true;
+        }
+        for (size_t r = 1; r < s; r++) {
+            m.mul(x, x, x);
+            if (x == minus_one) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Strong Lucas test with Selfridge's parameters P = 1, Q = (1 - D) / 4
+    bool strong_lucas_probable_prime(montgomery &m, big_integer const &n, uint const *n_data, size_t len) {
+        int d = 5;
+        while (true) {
+            int j = jacobi(d, n_data, len);
+            if (j == -1) {
+                break;
+            }
+            if (j == 0) {
+                return false;
+            }
+            d = (d > 0 ? -d - 2 : -d + 2);
+        }
+        int q = (1 - d) / 4;
+
+        montgomery::residue rd = m.convert(d < 0 ? n + d : big_integer(d));
+        montgomery::residue rq = m.convert(q < 0 ? n + q : big_integer(q));
+
+        big_integer k = n + 1;
+        size_t s = 0;
+        while (!montgomery::test_bit(k, s)) {
+            s++;
+        }
+        k >>= (int) s;
+
+        montgomery::residue u = m.one(), v = m.one(), qk = rq, t;
+        for (size_t i = bit_length(k) - 1; i > 0; i--) {
+            m.mul(u, u, v);
+            m.mul(v, v, v);
+            t = qk;
+            m.add(t, qk);
+            m.sub(v, t);
+            m.mul(qk, qk, qk);
+            if (montgomery::test_bit(k, i - 1)) {
+                t = u;
+                m.add(t, v);
+                m.half(t);
+                m.mul(u, rd, u);
+                m.add(v, u);
+                m.half(v);
+                u = t;
+                m.mul(qk, qk, rq);
+            }
+        }
+        if (m.is_zero(u) || m.is_zero(v)) {
+            return true;
+        }
+        for (size_t r = 1; r < s; r++) {
+            m.mul(v, v, v);
+            t = qk;
+            m.add(t, qk);
+            m.sub(v, t);
+            if (m.is_zero(v)) {
+                return true;
+            }
+            m.mul(qk, qk, qk);
+        }
+        return false;
+    }
+
+    // n is odd, greater than sieve_limit^2 and free of small factors
+    bool baillie_psw(big_integer const &n, uint const *n_data, size_t len) {
+        montgomery m(n);
+        return strong_probable_prime(m, n) && !is_square(n, n_data, len) &&
+               strong_lucas_probable_prime(m, n, n_data, len);
+    }
+
+    bool small_or_trial(uint const *n_data, size_t len, bool &result) {
+        if (len == 1 && n_data[0] < sieve_limit) {
+            result = !sieve()[n_data[0]];
+            return true;
+        }
+        for (uint p : small_primes()) {
+            if (mod_small(n_data, len, p) == 0) {
+                result = false;
+                return true;
+            }
+        }
+        if (len == 1 && n_data[0] < sieve_limit * sieve_limit) {
+            result = true;
+            return true;
+        }
+        return false;
+    }
+}
+
+bool is_probable_prime(big_integer const &n) {
+    if (n.negative() || n.size() == 0) {
+        return false;
+    }
+    uint const *n_data = n.data.data();
+    size_t len = n.size();
+    if (n_data[len - 1] == 0) {
+        len--;
+    }
+    bool result;
+    if (small_or_trial(n_data, len, result)) {
+        return result;
+    }
+    return baillie_psw(n, n_data, len);
+}
+
+std::vector<bool> is_probable_prime(std::vector<big_integer> const &candidates, unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<char> res(candidates.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&] {
+        for (size_t i; (i = next++) < candidates.size();) {
+            res[i] = is_probable_prime(candidates[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads && i < candidates.size(); i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : pool) {
+        t.join();
+    }
+    return std::vector<bool>(res.begin(), res.end());
+}
+
+big_integer next_prime(big_integer const &n) {
+    if (n < 2) {
+        return 2;
+    }
+    big_integer c = n + 1;
+    if (!montgomery::test_bit(c, 0)) {
+        ++c;
+    }
+    if (c < sieve_limit * sieve_limit) {
+        while (!is_probable_prime(c)) {
+            c += 2;
+        }
+        return c;
+    }
+
+    // Sieve consecutive odd candidates by updating remainders instead of dividing again
+    std::vector<uint> const &primes = small_primes();
+    std::vector<uint> rem(primes.size());
+    for (size_t i = 0; i < primes.size(); i++) {
+        rem[i] = mod_small(c.data.data(), c.size(), primes[i]);
+    }
+    while (true) {
+        bool candidate = true;
+        for (size_t i = 0; i < primes.size() && candidate; i++) {
+            candidate = (rem[i] != 0);
+        }
+        if (candidate) {
+            uint const *c_data = c.data.data();
+            size_t len = c.size();
+            if (c_data[len - 1] == 0) {
+                len--;
+            }
+            if (baillie_psw(c, c_data, len)) {
+                return c;
+            }
+        }
+        c += 2;
+        for (size_t i = 0; i < primes.size(); i++) {
+            rem[i] += 2;
+            if (rem[i] >= primes[i]) {
+                rem[i] -= primes[i];
+            }
+        }
+    }
+}
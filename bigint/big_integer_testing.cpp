@@ -3,9 +3,15 @@
 #include <cstdlib>
 #include <vector>
 #include <utility>
+#include <sstream>
+#include <unordered_map>
 #include <gtest/gtest.h>
 
 #include "big_integer.h"
+#include "big_accumulator.h"
+#include "big_fixed.h"
+#include "big_rational.h"
+#include "limb_kernels.h"
 
 TEST(correctness, two_plus_two)
 {
@@ -735,3 +741,369 @@ TEST(correctness, div_randomized)
         EXPECT_LT(residue, divisor);
     }
 }
+
+TEST(correctness, probable_prime_small)
+{
+    std::vector<bool> composite(5000);
+    for (int i = 2; i < 5000; i++)
+        for (int j = 2 * i; j < 5000; j += i)
+            composite[j] = true;
+
+    for (int i = -10; i < 5000; i++)
+        EXPECT_EQ(is_probable_prime(i), i >= 2 && !composite[i]) << i;
+}
+
+TEST(correctness, probable_prime_long)
+{
+    big_integer m127 = (big_integer(1) << 127) - 1;
+    big_integer m89 = (big_integer(1) << 89) - 1;
+
+    EXPECT_TRUE(is_probable_prime(m127));
+    EXPECT_TRUE(is_probable_prime(m89));
+    EXPECT_TRUE(is_probable_prime(big_integer("1000000007")));
+    EXPECT_TRUE(is_probable_prime(big_integer("170141183460469231731687303715884105727")));
+    EXPECT_FALSE(is_probable_prime(m127 * m89));
+    EXPECT_FALSE(is_probable_prime((big_integer(1) << 128) + 1));
+    EXPECT_FALSE(is_probable_prime(-m127));
+}
+
+TEST(correctness, probable_prime_pseudoprimes)
+{
+    // strong pseudoprimes to base 2 without factors below the trial division bound
+    EXPECT_FALSE(is_probable_prime(1093 * 1093));
+    EXPECT_FALSE(is_probable_prime(3511 * 3511));
+    EXPECT_FALSE(is_probable_prime(big_integer("3825123056546413051")));
+    EXPECT_FALSE(is_probable_prime(big_integer("318665857834031151167461")));
+
+    // Carmichael numbers
+    EXPECT_FALSE(is_probable_prime(big_integer("2152302898747")));
+    EXPECT_FALSE(is_probable_prime(big_integer("3474749660383")));
+}
+
+TEST(correctness, next_prime)
+{
+    EXPECT_EQ(next_prime(-5), 2);
+    EXPECT_EQ(next_prime(2), 3);
+    EXPECT_EQ(next_prime(1000), 1009);
+    EXPECT_EQ(next_prime(big_integer("1000000000000")), big_integer("1000000000039"));
+    EXPECT_EQ(next_prime(big_integer(1) << 64), (big_integer(1) << 64) + 13);
+    EXPECT_EQ(next_prime((big_integer(1) << 127) - 2), (big_integer(1) << 127) - 1);
+}
+
+TEST(correctness, probable_prime_batch)
+{
+    std::vector<big_integer> candidates;
+    for (int i = 0; i < 200; i++)
+        candidates.push_back((big_integer(1) << 100) + i);
+
+    std::vector<bool> batch = is_probable_prime(candidates, 4);
+    ASSERT_EQ(batch.size(), candidates.size());
+    for (size_t i = 0; i != candidates.size(); ++i)
+        EXPECT_EQ(batch[i], is_probable_prime(candidates[i]));
+}
+
+TEST(correctness, random_bits)
+{
+    std::mt19937 engine(1);
+    big_integer limit = big_integer(1) << 100;
+    bool top_bit = false;
+    for (int i = 0; i < 1000; i++)
+    {
+        big_integer a = random_bits(engine, 100);
+        EXPECT_GE(a, 0);
+        EXPECT_LT(a, limit);
+        top_bit |= (a >= (limit >> 1));
+    }
+    EXPECT_TRUE(top_bit);
+    EXPECT_EQ(random_bits(engine, 0), 0);
+    EXPECT_LT(random_bits(engine, 31), big_integer(1) << 31);
+    EXPECT_LT(random_bits(engine, 32), big_integer(1) << 32);
+}
+
+TEST(correctness, random_below)
+{
+    std::mt19937 engine(1);
+    big_integer bound = (big_integer(1) << 64) + 5;
+    for (int i = 0; i < 1000; i++)
+    {
+        big_integer a = random_below(engine, bound);
+        EXPECT_GE(a, 0);
+        EXPECT_LT(a, bound);
+    }
+
+    int counts[3] = {0, 0, 0};
+    for (int i = 0; i < 3000; i++)
+    {
+        big_integer a = random_below(engine, 3);
+        counts[a == 0 ? 0 : a == 1 ? 1 : 2]++;
+    }
+    for (int count : counts)
+    {
+        EXPECT_GT(count, 850);
+        EXPECT_LT(count, 1150);
+    }
+}
+
+TEST(correctness, accumulator_sum)
+{
+    big_accumulator acc;
+    big_integer sum;
+    std::mt19937 engine(1);
+    for (int i = 0; i < 1000; i++)
+    {
+        big_integer a = random_bits(engine, engine() % 300);
+        if (engine() % 2)
+            a = -a;
+        if (engine() % 3)
+        {
+            acc += a;
+            sum += a;
+        }
+        else
+        {
+            acc -= a;
+            sum -= a;
+        }
+        if (i % 97 == 0)
+        {
+            ASSERT_EQ(acc.value(), sum);
+        }
+    }
+    EXPECT_EQ(acc.value(), sum);
+    EXPECT_TRUE(acc == sum);
+}
+
+TEST(correctness, accumulator_carries)
+{
+    big_integer max = std::numeric_limits<int>::max();
+    big_integer min = std::numeric_limits<int>::min();
+    big_accumulator acc = (big_integer(1) << 96) - 1;
+
+    acc += 1;
+    EXPECT_EQ(acc, big_integer(1) << 96);
+    acc -= big_integer(1) << 97;
+    EXPECT_EQ(acc, -(big_integer(1) << 96));
+    acc -= min;
+    acc -= min;
+    EXPECT_EQ(acc, -(big_integer(1) << 96) + (big_integer(1) << 32));
+    acc += (big_integer(1) << 96) - (big_integer(1) << 32);
+    EXPECT_EQ(acc, 0);
+    acc -= 1;
+    EXPECT_EQ(acc, -1);
+    acc += max;
+    acc += max;
+    EXPECT_EQ(acc, 2 * max - 1);
+    EXPECT_GT(acc, 0);
+    EXPECT_LT(acc, big_integer(1) << 32);
+}
+
+TEST(correctness, hex_conv)
+{
+    EXPECT_EQ(to_hex_string(0), "0");
+    EXPECT_EQ(to_hex_string(255), "ff");
+    EXPECT_EQ(to_hex_string(-31), "-1f");
+    EXPECT_EQ(to_hex_string(std::numeric_limits<int>::min()), "-80000000");
+    EXPECT_EQ(to_hex_string(big_integer(1) << 100), "1" + std::string(25, '0'));
+    EXPECT_EQ(to_hex_string(big_integer("1311768467463790320")), "123456789abcdef0");
+
+    EXPECT_EQ(from_hex("0"), 0);
+    EXPECT_EQ(from_hex("-0x1F"), -31);
+    EXPECT_EQ(from_hex("+ffffffff"), big_integer(0xffffffffu));
+    EXPECT_EQ(from_hex("1" + std::string(25, '0')), big_integer(1) << 100);
+    EXPECT_THROW(from_hex(""), std::invalid_argument);
+    EXPECT_THROW(from_hex("0x"), std::invalid_argument);
+    EXPECT_THROW(from_hex("12g4"), std::invalid_argument);
+}
+
+TEST(correctness, hex_randomized)
+{
+    std::mt19937 engine(1);
+    for (int i = 0; i < 200; i++)
+    {
+        big_integer a = random_bits(engine, engine() % 1000);
+        if (i % 2)
+            a = -a;
+        ASSERT_EQ(from_hex(to_hex_string(a)), a);
+    }
+}
+
+TEST(correctness, hex_stream)
+{
+    std::stringstream s;
+    s << std::hex << big_integer(-255) << ' ' << std::showbase << std::uppercase << big_integer(171)
+      << ' ' << std::dec << big_integer(171);
+    EXPECT_EQ(s.str(), "-ff 0XAB 171");
+}
+
+TEST(correctness, hash)
+{
+    std::hash<big_integer> h;
+    big_integer a = (big_integer(1) << 200) + 12345;
+    big_integer b = a;
+    big_integer c = (big_integer(1) << 200) + 12345;
+
+    EXPECT_EQ(h(a), h(b));
+    EXPECT_EQ(h(a), h(c));
+    EXPECT_EQ(h(0), h(big_integer()));
+    EXPECT_NE(h(1), h(-1));
+
+    b += 1;
+    EXPECT_NE(h(a), h(b));
+    b -= 1;
+    EXPECT_EQ(h(a), h(b));
+    EXPECT_EQ(h(a), h(c));
+}
+
+TEST(correctness, hash_unordered_map)
+{
+    std::unordered_map<big_integer, int> map;
+    for (int i = 0; i < 1000; i++)
+        map[(big_integer(i) << 100) - i] = i;
+
+    EXPECT_EQ(map.size(), 1000u);
+    for (int i = 0; i < 1000; i++)
+        EXPECT_EQ(map[(big_integer(i) << 100) - i], i);
+}
+
+TEST(correctness, move)
+{
+    big_integer a = big_integer(1) << 100;
+    big_integer b = std::move(a);
+    EXPECT_EQ(b, big_integer(1) << 100);
+    EXPECT_EQ(a, 0);
+
+    a = std::move(b);
+    EXPECT_EQ(a, big_integer(1) << 100);
+    a += 1;
+    EXPECT_EQ(a, (big_integer(1) << 100) + 1);
+}
+
+TEST(correctness, gcd)
+{
+    EXPECT_EQ(gcd(0, 0), 0);
+    EXPECT_EQ(gcd(0, -5), 5);
+    EXPECT_EQ(gcd(12, 18), 6);
+    EXPECT_EQ(gcd(-12, 18), 6);
+
+    big_integer fib_a = 1, fib_b = 1;
+    for (int i = 0; i < 300; i++)
+    {
+        big_integer t = fib_a + fib_b;
+        fib_a = fib_b;
+        fib_b = t;
+    }
+    EXPECT_EQ(gcd(fib_a, fib_b), 1);
+
+    std::mt19937 engine(1);
+    for (int i = 0; i < 100; i++)
+    {
+        big_integer g = random_bits(engine, engine() % 200) + 1;
+        big_integer a = random_bits(engine, engine() % 300);
+        big_integer b = random_bits(engine, engine() % 300);
+        big_integer d = gcd(a * g, b * g);
+        ASSERT_EQ((a * g) % d, 0);
+        ASSERT_EQ((b * g) % d, 0);
+        ASSERT_EQ(gcd((a * g) / d, (b * g) / d), 1);
+        ASSERT_EQ(d % g, 0);
+    }
+}
+
+TEST(correctness, rational_arithmetic)
+{
+    big_rational a(1, 3), b(1, 6);
+    EXPECT_EQ(a + b, big_rational(1, 2));
+    EXPECT_EQ(to_string(a + b), "1/2");
+    EXPECT_EQ(to_string(a - b - b), "0");
+    EXPECT_EQ(to_string(a * b), "1/18");
+    EXPECT_EQ(to_string(a / b), "2");
+    EXPECT_EQ(to_string(big_rational(4, -6)), "-2/3");
+    EXPECT_EQ(big_rational(4, -6).denominator(), 3);
+    EXPECT_LT(b, a);
+    EXPECT_GT(-b, -a);
+    EXPECT_THROW(big_rational(1, 0), std::domain_error);
+    EXPECT_THROW(a / big_rational(0), std::domain_error);
+}
+
+TEST(correctness, rational_harmonic)
+{
+    big_rational sum;
+    for (int i = 1; i <= 100; i++)
+        sum += big_rational(1, i);
+
+    EXPECT_EQ(sum.numerator(), big_integer("14466636279520351160221518043104131447711"));
+    EXPECT_EQ(sum.denominator(), big_integer("2788815009188499086581352357412492142272"));
+}
+
+TEST(correctness, fixed_arithmetic)
+{
+    typedef big_fixed<2> money;
+    money a("10.25"), b("0.10");
+    EXPECT_EQ(to_string(a + b), "10.35");
+    EXPECT_EQ(to_string(b - a), "-10.15");
+    EXPECT_EQ(to_string(a * b), "1.02");
+    EXPECT_EQ(to_string(a / money(3)), "3.42");
+    EXPECT_EQ(to_string(money(-7)), "-7.00");
+    EXPECT_EQ(to_string(money("-0.05")), "-0.05");
+    EXPECT_EQ(to_string(money("1.005")), "1.00");
+    EXPECT_EQ(to_string(money("1.015")), "1.02");
+    EXPECT_EQ(to_string(big_fixed<3>(big_rational(2, 3))), "0.667");
+    EXPECT_EQ(money(big_rational(1, 4)).to_rational(), big_rational(1, 4));
+}
+
+TEST(correctness, fixed_rounding)
+{
+    EXPECT_EQ(divide_rounded(5, 2, rounding::half_even), 2);
+    EXPECT_EQ(divide_rounded(7, 2, rounding::half_even), 4);
+    EXPECT_EQ(divide_rounded(-5, 2, rounding::half_even), -2);
+    EXPECT_EQ(divide_rounded(-5, 2, rounding::half_away_from_zero), -3);
+    EXPECT_EQ(divide_rounded(-7, 3, rounding::floor), -3);
+    EXPECT_EQ(divide_rounded(-7, 3, rounding::ceiling), -2);
+    EXPECT_EQ(divide_rounded(7, -3, rounding::toward_zero), -2);
+    EXPECT_EQ(divide_rounded(7, -3, rounding::away_from_zero), -3);
+    EXPECT_EQ(divide_rounded(6, -3, rounding::away_from_zero), -2);
+
+    typedef big_fixed<1, rounding::floor> floored;
+    EXPECT_EQ(to_string(floored("-0.01")), "-0.1");
+    EXPECT_EQ(to_string(floored("2.5") * floored("0.5")), "1.2");
+}
+
+TEST(correctness, limb_kernels)
+{
+    std::mt19937 engine(1);
+    limb_kernels const &k = kernels();
+    for (int itn = 0; itn < 1000; itn++)
+    {
+        size_t n = engine() % 12;
+        std::vector<uint32_t> a(n + 1), b(n + 1);
+        for (size_t i = 0; i <= n; i++)
+        {
+            a[i] = (engine() % 4 == 0) ? 0xffffffffu : (uint32_t) engine();
+            b[i] = (engine() % 4 == 0) ? 0xffffffffu : (uint32_t) engine();
+        }
+        uint32_t v = (uint32_t) engine();
+        unsigned cnt = 1 + engine() % 31;
+
+        std::vector<uint32_t> expected = b, actual = b;
+        ASSERT_EQ(portable_kernels.add_n(&expected[0], &a[0], &b[0], n), k.add_n(&actual[0], &a[0], &b[0], n));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(portable_kernels.sub_n(&expected[0], &a[0], &b[0], n), k.sub_n(&actual[0], &a[0], &b[0], n));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(portable_kernels.mul_1(&expected[0], &a[0], n, v), k.mul_1(&actual[0], &a[0], n, v));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(portable_kernels.addmul_1(&expected[0], &a[0], n, v), k.addmul_1(&actual[0], &a[0], n, v));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(portable_kernels.lshift(&expected[0], &expected[0], n, cnt), k.lshift(&actual[0], &actual[0], n, cnt));
+        ASSERT_EQ(expected, actual);
+        ASSERT_EQ(portable_kernels.rshift(&expected[0], &expected[0], n, cnt), k.rshift(&actual[0], &actual[0], n, cnt));
+        ASSERT_EQ(expected, actual);
+    }
+
+    std::vector<uint32_t> x = {0xffffffffu, 0xffffffffu, 1};
+    std::vector<uint32_t> y = {1, 0, 0};
+    EXPECT_EQ(k.add_n(&x[0], &x[0], &y[0], 3), 0u);
+    EXPECT_EQ(x, std::vector<uint32_t>({0, 0, 2}));
+    EXPECT_EQ(k.sub_n(&x[0], &x[0], &y[0], 3), 0u);
+    EXPECT_EQ(x, std::vector<uint32_t>({0xffffffffu, 0xffffffffu, 1}));
+    EXPECT_EQ(k.mul_1(&x[0], &x[0], 3, 2), 0u);
+    EXPECT_EQ(x, std::vector<uint32_t>({0xfffffffeu, 0xffffffffu, 3}));
+}
@@ -0,0 +1,185 @@
+#include "big_rational.h"
+
+#include <ostream>
+#include <stdexcept>
+
+namespace {
+    // Reduce once the fraction is this many bits longer than twice its last reduced size
+    const size_t reduce_slack = 256;
+}
+
+big_rational::big_rational() : num(0), den(1), reduced(true), reduced_bits(0) {}
+
+big_rational::big_rational(int a) : num(a), den(1), reduced(true), reduced_bits(0) {}
+
+big_rational::big_rational(big_integer a) : num(std::move(a)), den(1), reduced(true), reduced_bits(0) {}
+
+big_rational::big_rational(big_integer num, big_integer den)
+        : num(std::move(num)), den(std::move(den)), reduced(false), reduced_bits(0) {
+    if (this->den == 0) {
+        throw std::domain_error("big_rational: zero denominator");
+    }
+    normalize_sign();
+}
+
+big_rational &big_rational::operator+=(big_rational const &rhs) {
+    if (den == rhs.den) {
+        num += rhs.num;
+    } else {
+        num *= rhs.den;
+        num += rhs.num * den;
+        den *= rhs.den;
+    }
+    reduced = false;
+    maybe_canonicalize();
+    return *this;
+}
+
+big_rational &big_rational::operator-=(big_rational const &rhs) {
+    if (den == rhs.den) {
+        num -= rhs.num;
+    } else {
+        num *= rhs.den;
+        num -= rhs.num * den;
+        den *= rhs.den;
+    }
+    reduced = false;
+    maybe_canonicalize();
+    return *this;
+}
+
+big_rational &big_rational::operator*=(big_rational const &rhs) {
+    num *= rhs.num;
+    den *= rhs.den;
+    reduced = false;
+    maybe_canonicalize();
+    return *this;
+}
+
+big_rational &big_rational::operator/=(big_rational const &rhs) {
+    if (rhs.num == 0) {
+        throw std::domain_error("big_rational: division by zero");
+    }
+    if (this == &rhs) {
+        return *this = 1;
+    }
+    num *= rhs.den;
+    den *= rhs.num;
+    normalize_sign();
+    reduced = false;
+    maybe_canonicalize();
+    return *this;
+}
+
+big_rational big_rational::operator+() const {
+    return *this;
+}
+
+big_rational big_rational::operator-() const {
+    big_rational r = *this;
+    r.num = -r.num;
+    return r;
+}
+
+big_integer const &big_rational::numerator() const {
+    canonicalize();
+    return num;
+}
+
+big_integer const &big_rational::denominator() const {
+    canonicalize();
+    return den;
+}
+
+void big_rational::canonicalize() const {
+    if (reduced) {
+        return;
+    }
+    if (num == 0) {
+        den = 1;
+    } else {
+        big_integer g = gcd(num, den);
+        if (g != 1) {
+            num /= g;
+            den /= g;
+        }
+    }
+    reduced = true;
+    reduced_bits = bit_length(num) + bit_length(den);
+}
+
+void big_rational::normalize_sign() {
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+}
+
+void big_rational::maybe_canonicalize() {
+    if (bit_length(num) + bit_length(den) > 2 * reduced_bits + reduce_slack) {
+        canonicalize();
+    }
+}
+
+big_rational operator+(big_rational a, big_rational const &b) {
+    a += b;
+    return a;
+}
+
+big_rational operator-(big_rational a, big_rational const &b) {
+    a -= b;
+    return a;
+}
+
+big_rational operator*(big_rational a, big_rational const &b) {
+    a *= b;
+    return a;
+}
+
+big_rational operator/(big_rational a, big_rational const &b) {
+    a /= b;
+    return a;
+}
+
+// Denominators are positive, so cross-multiplying preserves order and no gcd is needed
+bool operator==(big_rational const &a, big_rational const &b) {
+    if (a.den == b.den) {
+        return a.num == b.num;
+    }
+    return a.num * b.den == b.num * a.den;
+}
+
+bool operator!=(big_rational const &a, big_rational const &b) {
+    return !(a == b);
+}
+
+bool operator<(big_rational const &a, big_rational const &b) {
+    if (a.den == b.den) {
+        return a.num < b.num;
+    }
+    return a.num * b.den < b.num * a.den;
+}
+
+bool operator>(big_rational const &a, big_rational const &b) {
+    return b < a;
+}
+
+bool operator<=(big_rational const &a, big_rational const &b) {
+    return !(b < a);
+}
+
+bool operator>=(big_rational const &a, big_rational const &b) {
+    return !(a < b);
+}
+
+std::string to_string(big_rational const &a) {
+    std::string res = to_string(a.numerator());
+    if (a.denominator() != 1) {
+        res += "/" + to_string(a.denominator());
+    }
+    return res;
+}
+
+std::ostream &operator<<(std::ostream &s, big_rational const &a) {
+    return s << to_string(a);
+}
@@ -0,0 +1,79 @@
+#ifndef BIGINT_BIG_RATIONAL_H
+#define BIGINT_BIG_RATIONAL_H
+
+#include <string>
+#include "big_integer.h"
+
+// Exact fraction with a positive denominator. Results are not reduced after
+// every operation: the gcd is taken when the fraction is read out or when its
+// size has grown well past the last reduced size.
+class big_rational {
+public:
+    big_rational();
+
+    big_rational(int a);
+
+    big_rational(big_integer a);
+
+    // throws std::domain_error if den is zero
+    big_rational(big_integer num, big_integer den);
+
+    big_rational &operator+=(big_rational const &rhs);
+
+    big_rational &operator-=(big_rational const &rhs);
+
+    big_rational &operator*=(big_rational const &rhs);
+
+    // throws std::domain_error if rhs is zero
+    big_rational &operator/=(big_rational const &rhs);
+
+    big_rational operator+() const;
+
+    big_rational operator-() const;
+
+    big_integer const &numerator() const;
+
+    big_integer const &denominator() const;
+
+    void canonicalize() const;
+
+    friend bool operator==(big_rational const &a, big_rational const &b);
+
+    friend bool operator<(big_rational const &a, big_rational const &b);
+
+private:
+    mutable big_integer num;
+    mutable big_integer den;
+    mutable bool reduced;
+    mutable size_t reduced_bits;
+
+    void normalize_sign();
+
+    void maybe_canonicalize();
+};
+
+big_rational operator+(big_rational a, big_rational const &b);
+
+big_rational operator-(big_rational a, big_rational const &b);
+
+big_rational operator*(big_rational a, big_rational const &b);
+
+big_rational operator/(big_rational a, big_rational const &b);
+
+bool operator==(big_rational const &a, big_rational const &b);
+
+bool operator!=(big_rational const &a, big_rational const &b);
+
+bool operator<(big_rational const &a, big_rational const &b);
+
+bool operator>(big_rational const &a, big_rational const &b);
+
+bool operator<=(big_rational const &a, big_rational const &b);
+
+bool operator>=(big_rational const &a, big_rational const &b);
+
+std::string to_string(big_rational const &a);
+
+std::ostream &operator<<(std::ostream &s, big_rational const &a);
+
+#endif //BIGINT_BIG_RATIONAL_H
@@ -0,0 +1,185 @@
+; Limb loops for big_integer: 32-bit limbs, System V AMD64 calling convention.
+; Every kernel accepts n = 0 and allows rp == up.
+
+                section         .text
+
+                global          bigint_add_n
+                global          bigint_sub_n
+                global          bigint_mul_1
+                global          bigint_addmul_1
+                global          bigint_lshift
+                global          bigint_rshift
+
+; rp[] = up[] + vp[], two limbs per adc
+;    rdi -- rp, rsi -- up, rdx -- vp, rcx -- n
+; result:
+;    eax -- carry out
+bigint_add_n:
+                mov             r8, rcx
+                xor             eax, eax
+                shr             rcx, 1
+                jz              .tail
+                clc
+.loop:
+                mov             r9, [rsi]
+                adc             r9, [rdx]
+                mov             [rdi], r9
+                lea             rsi, [rsi + 8]
+                lea             rdx, [rdx + 8]
+                lea             rdi, [rdi + 8]
+                dec             rcx
+                jnz             .loop
+                setc            al
+.tail:
+                test            r8, 1
+                jz              .done
+                mov             r9d, [rsi]
+                mov             r10d, [rdx]
+                add             r9, r10
+                add             r9, rax
+                mov             [rdi], r9d
+                shr             r9, 32
+                mov             eax, r9d
+.done:
+                ret
+
+; rp[] = up[] - vp[], two limbs per sbb
+;    rdi -- rp, rsi -- up, rdx -- vp, rcx -- n
+; result:
+;    eax -- borrow out
+bigint_sub_n:
+                mov             r8, rcx
+                xor             eax, eax
+                shr             rcx, 1
+                jz              .tail
+                clc
+.loop:
+                mov             r9, [rsi]
+                sbb             r9, [rdx]
+                mov             [rdi], r9
+                lea             rsi, [rsi + 8]
+                lea             rdx, [rdx + 8]
+                lea             rdi, [rdi + 8]
+                dec             rcx
+                jnz             .loop
+                setc            al
+.tail:
+                test            r8, 1
+                jz              .done
+                mov             r9d, [rsi]
+                mov             r10d, [rdx]
+                sub             r9, r10
+                sub             r9, rax
+                mov             [rdi], r9d
+                shr             r9, 63
+                mov             eax, r9d
+.done:
+                ret
+
+; rp[] = up[] * v
+;    rdi -- rp, rsi -- up, rdx -- n, ecx -- v
+; result:
+;    eax -- high limb of the product
+bigint_mul_1:
+                mov             r8, rdx
+                mov             ecx, ecx
+                xor             r9d, r9d
+                xor             r10d, r10d
+                test            r8, r8
+                jz              .done
+.loop:
+                mov             eax, [rsi + r10 * 4]
+                imul            rax, rcx
+                add             rax, r9
+                mov             [rdi + r10 * 4], eax
+                shr             rax, 32
+                mov             r9, rax
+                inc             r10
+                cmp             r10, r8
+                jne             .loop
+.done:
+                mov             eax, r9d
+                ret
+
+; rp[] += up[] * v
+;    rdi -- rp, rsi -- up, rdx -- n, ecx -- v
+; result:
+;    eax -- limb carried out of rp[n - 1]
+bigint_addmul_1:
+                mov             r8, rdx
+                mov             ecx, ecx
+                xor             r9d, r9d
+                xor             r10d, r10d
+                test            r8, r8
+                jz              .done
+.loop:
+                mov             eax, [rsi + r10 * 4]
+                imul            rax, rcx
+                mov             r11d, [rdi + r10 * 4]
+                add             rax, r11
+                add             rax, r9
+                mov             [rdi + r10 * 4], eax
+                shr             rax, 32
+                mov             r9, rax
+                inc             r10
+                cmp             r10, r8
+                jne             .loop
+.done:
+                mov             eax, r9d
+                ret
+
+; rp[] = up[] << cnt, walking from the top limb down
+;    rdi -- rp, rsi -- up, rdx -- n, ecx -- cnt (1..31)
+; result:
+;    eax -- bits shifted out of up[n - 1], in the low bits
+bigint_lshift:
+                xor             eax, eax
+                test            rdx, rdx
+                jz              .done
+                mov             r8d, [rsi + rdx * 4 - 4]
+                shld            eax, r8d, cl
+                dec             rdx
+                jz              .last
+.loop:
+                mov             r9d, [rsi + rdx * 4 - 4]
+                mov             r10d, r8d
+                shld            r10d, r9d, cl
+                mov             [rdi + rdx * 4], r10d
+                mov             r8d, r9d
+                dec             rdx
+                jnz             .loop
+.last:
+                shl             r8d, cl
+                mov             [rdi], r8d
+.done:
+                ret
+
+; rp[] = up[] >> cnt, walking from the bottom limb up
+;    rdi -- rp, rsi -- up, rdx -- n, ecx -- cnt (1..31)
+; result:
+;    eax -- bits shifted out of up[0], in the high bits
+bigint_rshift:
+                xor             eax, eax
+                test            rdx, rdx
+                jz              .done
+                mov             r8d, [rsi]
+                shrd            eax, r8d, cl
+                xor             r11d, r11d
+                dec             rdx
+                jz              .last
+.loop:
+                mov             r9d, [rsi + r11 * 4 + 4]
+                mov             r10d, r8d
+                shrd            r10d, r9d, cl
+                mov             [rdi + r11 * 4], r10d
+                mov             r8d, r9d
+                inc             r11
+                dec             rdx
+                jnz             .loop
+.last:
+                shr             r8d, cl
+                mov             [rdi + r11 * 4], r8d
+.done:
+                ret
+
+                section         .note.GNU-stack noalloc noexec nowrite progbits
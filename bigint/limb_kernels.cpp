@@ -0,0 +1,105 @@
+#include "limb_kernels.h"
+
+namespace {
+    uint32_t portable_add_n(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            carry += (uint64_t) up[i] + vp[i];
+            rp[i] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        return (uint32_t) carry;
+    }
+
+    uint32_t portable_sub_n(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n) {
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t cur = (uint64_t) up[i] - vp[i] - borrow;
+            rp[i] = (uint32_t) cur;
+            borrow = cur >> 63;
+        }
+        return (uint32_t) borrow;
+    }
+
+    uint32_t portable_mul_1(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            carry += (uint64_t) up[i] * v;
+            rp[i] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        return (uint32_t) carry;
+    }
+
+    uint32_t portable_addmul_1(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v) {
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; i++) {
+            carry += (uint64_t) up[i] * v + rp[i];
+            rp[i] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        return (uint32_t) carry;
+    }
+
+    uint32_t portable_lshift(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt) {
+        if (n == 0) {
+            return 0;
+        }
+        uint32_t out = up[n - 1] >> (32 - cnt);
+        for (size_t i = n - 1; i > 0; i--) {
+            rp[i] = (up[i] << cnt) | (up[i - 1] >> (32 - cnt));
+        }
+        rp[0] = up[0] << cnt;
+        return out;
+    }
+
+    uint32_t portable_rshift(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt) {
+        if (n == 0) {
+            return 0;
+        }
+        uint32_t out = up[0] << (32 - cnt);
+        for (size_t i = 0; i + 1 < n; i++) {
+            rp[i] = (up[i] >> cnt) | (up[i + 1] << (32 - cnt));
+        }
+        rp[n - 1] = up[n - 1] >> cnt;
+        return out;
+    }
+}
+
+limb_kernels const portable_kernels = {
+        portable_add_n,
+        portable_sub_n,
+        portable_mul_1,
+        portable_addmul_1,
+        portable_lshift,
+        portable_rshift
+};
+
+#ifdef BIGINT_ASM_KERNELS
+extern "C" {
+uint32_t bigint_add_n(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n);
+uint32_t bigint_sub_n(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n);
+uint32_t bigint_mul_1(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v);
+uint32_t bigint_addmul_1(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v);
+uint32_t bigint_lshift(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt);
+uint32_t bigint_rshift(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt);
+}
+
+limb_kernels const asm_kernels = {
+        bigint_add_n,
+        bigint_sub_n,
+        bigint_mul_1,
+        bigint_addmul_1,
+        bigint_lshift,
+        bigint_rshift
+};
+#endif
+
+limb_kernels const &kernels() {
+#ifdef BIGINT_ASM_KERNELS
+    static limb_kernels const &table = asm_kernels;
+#else
+    static limb_kernels const &table = portable_kernels;
+#endif
+    return table;
+}
@@ -0,0 +1,40 @@
+#ifndef BIGINT_LIMB_KERNELS_H
+#define BIGINT_LIMB_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Inner loops over 32-bit limbs shared by big_integer and montgomery. Every
+// kernel accepts n == 0 and allows rp == up.
+struct limb_kernels {
+    // rp = up + vp, returns the carry
+    uint32_t (*add_n)(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n);
+
+    // rp = up - vp, returns the borrow
+    uint32_t (*sub_n)(uint32_t *rp, uint32_t const *up, uint32_t const *vp, size_t n);
+
+    // rp = up * v, returns the high limb
+    uint32_t (*mul_1)(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v);
+
+    // rp += up * v, returns the high limb
+    uint32_t (*addmul_1)(uint32_t *rp, uint32_t const *up, size_t n, uint32_t v);
+
+    // rp = up << cnt for 0 < cnt < 32, returns the bits shifted out at the top
+    uint32_t (*lshift)(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt);
+
+    // rp = up >> cnt for 0 < cnt < 32, returns the bits shifted out at the
+    // bottom in the high bits of the result
+    uint32_t (*rshift)(uint32_t *rp, uint32_t const *up, size_t n, unsigned cnt);
+};
+
+extern limb_kernels const portable_kernels;
+
+#ifdef BIGINT_ASM_KERNELS
+extern limb_kernels const asm_kernels;
+#endif
+
+// Table picked once at startup: the NASM kernels when they were built, the
+// portable C++ loops otherwise
+limb_kernels const &kernels();
+
+#endif //BIGINT_LIMB_KERNELS_H
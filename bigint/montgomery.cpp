@@ -0,0 +1,158 @@
+#include "montgomery.h"
+#include "limb_kernels.h"
+
+#include <algorithm>
+
+montgomery::montgomery(big_integer const &n) {
+    size_t k = n.size();
+    uint const *n_data = n.data.data();
+    while (k > 0 && n_data[k - 1] == 0) {
+        k--;
+    }
+    mod.assign(n_data, n_data + k);
+
+    // Newton iteration doubles the number of correct low bits each step
+    uint x = mod[0];
+    for (int i = 0; i < 5; i++) {
+        x *= 2 - mod[0] * x;
+    }
+    inv = -x;
+
+    tmp.resize(2 * k + 1);
+    big_integer r = (big_integer(1) << (int) (2 * big_integer::log_base * k)) % n;
+    r2.assign(k, 0);
+    std::copy(r.data.data(), r.data.data() + std::min<size_t>(r.size(), k), r2.begin());
+    unit = residue(k, 0);
+    unit[0] = 1;
+    mul(unit, unit, r2);
+}
+
+montgomery::residue montgomery::convert(big_integer const &a) {
+    residue res(mod.size(), 0);
+    std::copy(a.data.data(), a.data.data() + std::min(a.size(), mod.size()), res.begin());
+    mul(res, res, r2);
+    return res;
+}
+
+big_integer montgomery::revert(residue const &a) {
+    residue plain(mod.size(), 0);
+    plain[0] = 1;
+    mul(plain, a, plain);
+
+    big_integer res;
+    res.data.resize((uint) plain.size());
+    std::copy(plain.begin(), plain.end(), res.data.data());
+    res.data.push_back(0);
+    res.shrink();
+    return res;
+}
+
+montgomery::residue const &montgomery::one() const {
+    return unit;
+}
+
+montgomery::residue montgomery::zero() const {
+    return residue(mod.size(), 0);
+}
+
+// Separated operand scanning: the full product first, then one reduction row
+// per limb, each row a single addmul_1 pass.
+void montgomery::mul(residue &res, residue const &a, residue const &b) {
+    size_t k = mod.size();
+    uint *t = tmp.data();
+    std::fill(tmp.begin(), tmp.end(), 0);
+    limb_kernels const &kern = kernels();
+
+    for (size_t i = 0; i < k; i++) {
+        t[i + k] = kern.addmul_1(t + i, a.data(), k, b[i]);
+    }
+    for (size_t i = 0; i < k; i++) {
+        uint carry = kern.addmul_1(t + i, mod.data(), k, t[i] * inv);
+        for (size_t j = i + k; carry && j <= 2 * k; j++) {
+            ull cur = (ull) t[j] + carry;
+            t[j] = (uint) cur;
+            carry = (uint) (cur >> big_integer::log_base);
+        }
+    }
+    if (t[2 * k] || !less_mod(t + k)) {
+        sub_mod(t + k);
+    }
+    res.assign(t + k, t + 2 * k);
+}
+
+void montgomery::add(residue &a, residue const &b) const {
+    uint carry = kernels().add_n(a.data(), a.data(), b.data(), mod.size());
+    if (carry || !less_mod(a.data())) {
+        sub_mod(a.data());
+    }
+}
+
+void montgomery::sub(residue &a, residue const &b) const {
+    if (kernels().sub_n(a.data(), a.data(), b.data(), mod.size())) {
+        kernels().add_n(a.data(), a.data(), mod.data(), mod.size());
+    }
+}
+
+void montgomery::half(residue &a) const {
+    uint top = 0;
+    if (a[0] & 1u) {
+        top = kernels().add_n(a.data(), a.data(), mod.data(), mod.size());
+    }
+    kernels().rshift(a.data(), a.data(), mod.size(), 1);
+    a.back() |= top << (big_integer::log_base - 1);
+}
+
+montgomery::residue montgomery::pow(residue const &a, big_integer const &e) {
+    const uint window = 4;
+    std::vector<residue> powers(1u << window, unit);
+    for (size_t i = 1; i < powers.size(); i++) {
+        mul(powers[i], powers[i - 1], a);
+    }
+
+    residue res = unit;
+    size_t bits = bit_length(e);
+    size_t top = (bits + window - 1) / window * window;
+    for (size_t i = top; i > 0; i -= window) {
+        for (uint j = 0; j < window; j++) {
+            mul(res, res, res);
+        }
+        uint digit = 0;
+        for (uint j = 0; j < window; j++) {
+            digit = digit * 2 + test_bit(e, i - j - 1);
+        }
+        if (digit) {
+            mul(res, res, powers[digit]);
+        }
+    }
+    return res;
+}
+
+bool montgomery::is_zero(residue const &a) const {
+    for (uint x : a) {
+        if (x) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool montgomery::test_bit(big_integer const &a, size_t bit) {
+    size_t limb = bit / big_integer::log_base;
+    if (limb >= a.size()) {
+        return a.negative();
+    }
+    return (a.data.data()[limb] >> (bit % big_integer::log_base)) & 1u;
+}
+
+bool montgomery::less_mod(uint const *a) const {
+    for (size_t i = mod.size(); i > 0; i--) {
+        if (a[i - 1] != mod[i - 1]) {
+            return a[i - 1] < mod[i - 1];
+        }
+    }
+    return false;
+}
+
+void montgomery::sub_mod(uint *a) const {
+    kernels().sub_n(a, a, mod.data(), mod.size());
+}
@@ -0,0 +1,51 @@
+#ifndef BIGINT_MONTGOMERY_H
+#define BIGINT_MONTGOMERY_H
+
+#include <vector>
+#include "big_integer.h"
+
+// Arithmetic modulo an odd n > 1 kept in Montgomery form x * 2^(32k) mod n,
+// where k is the number of limbs of n. Residues are plain k-limb vectors.
+class montgomery {
+public:
+    typedef std::vector<uint> residue;
+
+    explicit montgomery(big_integer const &n);
+
+    // a must lie in [0, n)
+    residue convert(big_integer const &a);
+
+    big_integer revert(residue const &a);
+
+    residue const &one() const;
+
+    residue zero() const;
+
+    // res may alias a or b
+    void mul(residue &res, residue const &a, residue const &b);
+
+    void add(residue &a, residue const &b) const;
+
+    void sub(residue &a, residue const &b) const;
+
+    void half(residue &a) const;
+
+    residue pow(residue const &a, big_integer const &e);
+
+    bool is_zero(residue const &a) const;
+
+    static bool test_bit(big_integer const &a, size_t bit);
+
+private:
+    std::vector<uint> mod;
+    uint inv;
+    residue r2;
+    residue unit;
+    std::vector<uint> tmp;
+
+    bool less_mod(uint const *a) const;
+
+    void sub_mod(uint *a) const;
+};
+
+#endif //BIGINT_MONTGOMERY_H
@@ -9,14 +9,14 @@ bool my_vector::empty() const {
 uint &my_vector::back() {
     if (is_big()) {
         check_unique();
-        return big->back();
+        return big->limbs.back();
     }
     return small;
 }
 
 uint my_vector::back() const {
     if (is_big()) {
-        return big->back();
+        return big->limbs.back();
     }
     return small;
 }
@@ -27,7 +27,7 @@ uint my_vector::size() const {
 
 uint my_vector::operator[](size_t ind) const {
     if (is_big()) {
-        return big->operator[](ind);
+        return big->limbs[ind];
     }
     return small;
 }
@@ -35,7 +35,7 @@ uint my_vector::operator[](size_t ind) const {
 uint &my_vector::operator[](size_t ind) {
     if (is_big()) {
         check_unique();
-        return big->operator[](ind);
+        return big->limbs[ind];
     }
     return small;
 }
@@ -43,9 +43,9 @@ uint &my_vector::operator[](size_t ind) {
 void my_vector::pop_back() {
     if (len > 2) {
         check_unique();
-        big->pop_back();
+        big->limbs.pop_back();
     } else if (len > 1) {
-        uint tmp = big->operator[](0);
+        uint tmp = big->limbs[0];
         big.reset();
         small = tmp;
     } else {
@@ -57,11 +57,11 @@ void my_vector::pop_back() {
 void my_vector::push_back(uint val) {
     if (is_big()) {
         check_unique();
-        big->push_back(val);
+        big->limbs.push_back(val);
     } else if (len > 0) {
-        big = std::make_shared<std::vector<uint>>(1, small);
+        big = std::make_shared<block>(1, small);
         //new(&big) std::shared_ptr<std::vector<uint>>(new std::vector<uint>(1, small));
-        big->push_back(val);
+        big->limbs.push_back(val);
     } else {
         small = val;
     }
@@ -71,20 +71,22 @@ void my_vector::push_back(uint val) {
 void my_vector::resize(uint size, uint value) {
     if (is_big()) {
         if (size < 2) {
-            uint tmp = operator[](0);
+            uint tmp = size ? big->limbs[0] : 0;
             big.reset();
             small = tmp;
         } else {
             check_unique();
-            big->resize(size, value);
+            big->limbs.resize(size, value);
         }
     } else if (size > 1) {
         uint tmp = small;
-        big = std::make_shared<std::vector<uint>>(size, value);
+        big = std::make_shared<block>(size, value);
         //new(&big) std::shared_ptr<std::vector<uint>>(new std::vector<uint>(size, value));
         if (size > 0) {
-            big->operator[](0) = tmp;
+            big->limbs[0] = tmp;
         }
+    } else if (size == 0) {
+        small = 0;
     }
     len = size;
 }
@@ -93,10 +95,10 @@ void my_vector::insert_begin(uint cnt) {
     resize(len + cnt);
     if (is_big()) {
         for (size_t i = len - 1; i >= cnt; i--) {
-            big->operator[](i) = big->operator[](i - cnt);
+            big->limbs[i] = big->limbs[i - cnt];
         }
         for (size_t i = 0; i < cnt; i++) {
-            big->operator[](i) = 0;
+            big->limbs[i] = 0;
         }
     } else {
         small = 0;
@@ -106,7 +108,7 @@ void my_vector::insert_begin(uint cnt) {
 void my_vector::erase_begin(uint cnt) {
     check_unique();
     for (size_t i = 0; i < len - cnt; i++) {
-        big->operator[](i) = big->operator[](i + cnt);
+        big->limbs[i] = big->limbs[i + cnt];
     }
     resize(len - cnt);
 }
@@ -115,7 +117,7 @@ bool operator==(my_vector const &a, my_vector const &b) {
     if (a.is_big() ^ b.is_big()) {
         return false;
     } else if (a.is_big()) {
-        return *a.big == *b.big;
+        return a.big->limbs == b.big->limbs;
     }
     return a.small == b.small;
 }
@@ -126,15 +128,67 @@ bool my_vector::is_big() const {
 
 void my_vector::check_unique() {
     if (!big.unique()) {
-        big = std::make_shared<std::vector<uint>>(*big);
+        big = std::make_shared<block>(big->limbs);
+    } else {
+        big->hash.store(0, std::memory_order_relaxed);
+    }
+}
+
+my_vector::block::block(std::vector<uint> const &limbs) : limbs(limbs), hash(0) {}
+
+my_vector::block::block(size_t size, uint value) : limbs(size, value), hash(0) {}
+
+namespace {
+    uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    size_t hash_limbs(uint const *d, size_t len) {
+        uint64_t h = mix(len + 0x9e3779b97f4a7c15ull);
+        size_t i = 0;
+        for (; i + 1 < len; i += 2) {
+            uint64_t word = d[i] | ((uint64_t) d[i + 1] << 32);
+            h = (h ^ mix(word)) * 0x9e3779b97f4a7c15ull;
+        }
+        if (i < len) {
+            h = (h ^ mix(d[i])) * 0x9e3779b97f4a7c15ull;
+        }
+        return (size_t) mix(h);
     }
 }
 
+size_t my_vector::hash() const {
+    if (!is_big()) {
+        return hash_limbs(&small, len);
+    }
+    // A shared block is never written to, so its hash stays valid until
+    // check_unique() hands the block to a single owner for modification.
+    size_t h = big->hash.load(std::memory_order_relaxed);
+    if (h == 0) {
+        h = hash_limbs(big->limbs.data(), len);
+        h += (h == 0);
+        big->hash.store(h, std::memory_order_relaxed);
+    }
+    return h;
+}
+
 my_vector::my_vector() {
     small = 0;
     len = 0;
 }
 
+my_vector::my_vector(my_vector const &other) : big(other.big), small(other.small), len(other.len) {}
+
+my_vector::my_vector(my_vector &&other) noexcept : big(std::move(other.big)), small(other.small), len(other.len) {
+    other.small = 0;
+    other.len = 0;
+}
+
 my_vector::~my_vector() {
     if (is_big()) {
         big.reset();
@@ -155,17 +209,26 @@ my_vector &my_vector::operator=(my_vector const &other) {
     return *this;
 }
 
+my_vector &my_vector::operator=(my_vector &&other) noexcept {
+    big = std::move(other.big);
+    small = other.small;
+    len = other.len;
+    other.small = 0;
+    other.len = 0;
+    return *this;
+}
+
 uint *my_vector::data() {
     if (is_big()) {
         check_unique();
-        return big->data();
+        return big->limbs.data();
     }
     return &small;
 }
 
 uint* const my_vector::data() const {
     if (is_big()) {
-        return big->data();
+        return big->limbs.data();
     }
     return const_cast<uint*>(&small);
 }
@@ -3,6 +3,8 @@
 
 typedef unsigned int uint;
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -10,6 +12,10 @@ class my_vector {
 public:
     my_vector();
 
+    my_vector(my_vector const &other);
+
+    my_vector(my_vector &&other) noexcept;
+
     ~my_vector();
 
     bool empty() const;
@@ -38,15 +44,28 @@ public:
 
     void erase_begin(uint i);
 
+    size_t hash() const;
+
 
 
     friend bool operator==(my_vector const &a, my_vector const &b);
 
     my_vector &operator=(my_vector const &other);
 
+    my_vector &operator=(my_vector &&other) noexcept;
+
 private:
+    struct block {
+        std::vector<uint> limbs;
+        std::atomic<size_t> hash;
+
+        explicit block(std::vector<uint> const &limbs);
+
+        block(size_t size, uint value);
+    };
+
     //union {
-    std::shared_ptr<std::vector<uint>> big;
+    std::shared_ptr<block> big;
     uint small;
     //};
 
@@ -0,0 +1,67 @@
+#ifndef HUFFMAN_BIT_READER_H
+#define HUFFMAN_BIT_READER_H
+
+#include <cstdint>
+#include <cstring>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+// LSB-first bit reader over a byte range with a 64-bit lookahead buffer.
+// The range can be swapped out between refills without losing buffered bits.
+class bit_reader {
+public:
+    bit_reader() = default;
+
+    bit_reader(unsigned char const *begin, unsigned char const *end) : ptr(begin), end(end) {}
+
+    void set_input(unsigned char const *begin, unsigned char const *end) {
+        ptr = begin;
+        this->end = end;
+    }
+
+    // Tops the buffer up to at least 56 bits while input lasts. With 8 bytes
+    // left this is one unaligned load.
+    void refill() {
+        if (end - ptr >= 8) {
+            ull word;
+            memcpy(&word, ptr, sizeof(word));
+            buf |= word << count;
+            ptr += (63 - count) >> 3;
+            count |= 56;
+        } else {
+            while (count <= 56 && ptr < end) {
+                buf |= (ull) *ptr++ << count;
+                count += 8;
+            }
+        }
+    }
+
+    ull peek() const {
+        return buf;
+    }
+
+    void consume(uint bits) {
+        buf >>= bits;
+        count -= bits;
+    }
+
+    uint available() const {
+        return count;
+    }
+
+    unsigned char const *position() const {
+        return ptr;
+    }
+
+    size_t bytes_left() const {
+        return end - ptr;
+    }
+
+private:
+    unsigned char const *ptr = nullptr;
+    unsigned char const *end = nullptr;
+    ull buf = 0;
+    uint count = 0;
+};
+
+#endif //HUFFMAN_BIT_READER_H
@@ -0,0 +1,44 @@
+#ifndef HUFFMAN_BIT_WRITER_H
+#define HUFFMAN_BIT_WRITER_H
+
+#include <cstdint>
+#include <cstring>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+// LSB-first bit writer with a 64-bit accumulator. put() only appends to the
+// accumulator; flush() stores it with one unaligned write and advances by the
+// whole bytes it held, so the caller decides how many puts fit between
+// flushes (at most 56 bits). The output needs 8 bytes of slack past the end.
+class bit_writer {
+public:
+    explicit bit_writer(unsigned char *out) : begin(out), ptr(out) {}
+
+    void put(ull bits, uint count) {
+        buf |= bits << used;
+        used += count;
+    }
+
+    void flush() {
+        memcpy(ptr, &buf, sizeof(buf));
+        uint bytes = used >> 3;
+        ptr += bytes;
+        used &= 7;
+        buf >>= bytes * 8;
+    }
+
+    // Flushes the last partial byte and returns the number of bytes written
+    size_t finish() {
+        flush();
+        memcpy(ptr, &buf, sizeof(buf));
+        return ptr - begin + (used + 7) / 8;
+    }
+
+private:
+    unsigned char *begin;
+    unsigned char *ptr;
+    ull buf = 0;
+    uint used = 0;
+};
+
+#endif //HUFFMAN_BIT_WRITER_H
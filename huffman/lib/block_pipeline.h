@@ -0,0 +1,240 @@
+#ifndef HUFFMAN_BLOCK_PIPELINE_H
+#define HUFFMAN_BLOCK_PIPELINE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+typedef uint32_t uint;
+
+// Processes a sequence of blocks on a pool of worker threads. The calling
+// thread fills slots with read() and drains them with write() in input
+// order; at most 2 * threads blocks are in flight at any time.
+//
+// With buffers > 0, read() runs on a thread of its own so reading, working
+// and writing overlap even with one worker; at most buffers blocks (and no
+// fewer than 2) are in flight.
+template<typename Slot>
+class block_pipeline {
+public:
+    explicit block_pipeline(uint threads, uint buffers = 0)
+            : threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), buffers(buffers) {}
+
+    // read(slot) returns false once the input is exhausted, write(slot)
+    // returns false to abort; run() returns false if it was aborted. If a
+    // callback throws, the pipeline stops, joins its threads and rethrows
+    // the first exception on the calling thread.
+    template<typename Read, typename Work, typename Write>
+    bool run(Read read, Work work, Write write) {
+        if (threads == 1 && buffers == 0) {
+            Slot slot;
+            while (read(slot)) {
+                work(slot);
+                if (!write(slot)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        slots.assign(buffers ? std::max(buffers, 2u) : 2 * threads, slot_state());
+        next_read = next_work = next_write = 0;
+        finished = false;
+        reading = true;
+        error = nullptr;
+
+        bool ok;
+        {
+            thread_guard guard(*this);
+            for (uint i = 0; i < threads; i++) {
+                guard.pool.emplace_back([&] {
+                    catch_into_error([&] { worker(work); });
+                });
+            }
+            if (buffers) {
+                guard.reader = std::thread([&] {
+                    catch_into_error([&] { read_all(read); });
+                });
+                ok = write_all(write);
+            } else {
+                ok = read_write_all(read, write);
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return ok;
+    }
+
+private:
+    struct slot_state {
+        Slot slot;
+        bool done = false;
+    };
+
+    uint threads;
+    uint buffers;
+    std::vector<slot_state> slots;
+    size_t next_read = 0, next_work = 0, next_write = 0;
+    bool finished = false, reading = false;
+    std::exception_ptr error;
+    std::mutex m;
+    std::condition_variable work_ready, block_done, slot_free;
+
+    // Stops the pipeline and joins its threads however run() is left: the
+    // reader first, so no block arrives after the workers are told to quit
+    struct thread_guard {
+        block_pipeline &pipeline;
+        std::thread reader;
+        std::vector<std::thread> pool;
+
+        explicit thread_guard(block_pipeline &pipeline) : pipeline(pipeline) {}
+
+        ~thread_guard() {
+            {
+                std::lock_guard<std::mutex> lock(pipeline.m);
+                pipeline.finished = true;
+                pipeline.slot_free.notify_all();
+            }
+            if (reader.joinable()) {
+                reader.join();
+            }
+            {
+                std::lock_guard<std::mutex> lock(pipeline.m);
+                pipeline.next_work = pipeline.next_read;
+                pipeline.work_ready.notify_all();
+            }
+            for (auto &t : pool) {
+                t.join();
+            }
+        }
+    };
+
+    // Runs f on a pipeline thread; an exception is kept for run() to rethrow
+    // and stops the other stages
+    template<typename F>
+    void catch_into_error(F f) {
+        try {
+            f();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+            finished = true;
+            work_ready.notify_all();
+            block_done.notify_all();
+            slot_free.notify_all();
+        }
+    }
+
+    // Reads and writes alternate on the calling thread
+    template<typename Read, typename Write>
+    bool read_write_all(Read &read, Write &write) {
+        bool ok = true;
+        bool more = true;
+        while (ok) {
+            while (more && next_read - next_write < slots.size()) {
+                more = read(slots[next_read % slots.size()].slot);
+                if (more) {
+                    std::lock_guard<std::mutex> lock(m);
+                    next_read++;
+                    work_ready.notify_one();
+                }
+            }
+            if (next_write == next_read) {
+                break;
+            }
+            slot_state &cur = slots[next_write % slots.size()];
+            {
+                std::unique_lock<std::mutex> lock(m);
+                block_done.wait(lock, [&] { return cur.done || error; });
+                if (error) {
+                    return false;
+                }
+                cur.done = false;
+            }
+            ok = write(cur.slot);
+            next_write++;
+        }
+        return ok;
+    }
+
+    // Fills free slots until the input ends or the writer gives up
+    template<typename Read>
+    void read_all(Read &read) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                slot_free.wait(lock, [&] { return next_read - next_write < slots.size() || finished; });
+                if (finished) {
+                    break;
+                }
+            }
+            bool more = read(slots[next_read % slots.size()].slot);
+            std::lock_guard<std::mutex> lock(m);
+            if (!more) {
+                break;
+            }
+            next_read++;
+            work_ready.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(m);
+        reading = false;
+        block_done.notify_all();
+    }
+
+    // Writes finished blocks in order while read_all() runs
+    template<typename Write>
+    bool write_all(Write &write) {
+        while (true) {
+            slot_state *cur;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                block_done.wait(lock, [&] {
+                    return error || (next_write < next_read ? slots[next_write % slots.size()].done : !reading);
+                });
+                if (error) {
+                    return false;
+                }
+                if (next_write == next_read) {
+                    return true;
+                }
+                cur = &slots[next_write % slots.size()];
+                cur->done = false;
+            }
+            bool ok = write(cur->slot);
+            std::lock_guard<std::mutex> lock(m);
+            next_write++;
+            slot_free.notify_one();
+            if (!ok) {
+                return false;
+            }
+        }
+    }
+
+    template<typename Work>
+    void worker(Work &work) {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(m);
+                work_ready.wait(lock, [&] { return next_work < next_read || finished; });
+                if (next_work == next_read || error) {
+                    return;
+                }
+                index = next_work++;
+            }
+            slot_state &cur = slots[index % slots.size()];
+            work(cur.slot);
+            std::lock_guard<std::mutex> lock(m);
+            cur.done = true;
+            block_done.notify_all();
+        }
+    }
+};
+
+#endif //HUFFMAN_BLOCK_PIPELINE_H
@@ -0,0 +1,70 @@
+#include "decode_table.h"
+#include <algorithm>
+#include "huffman.h"
+
+decode_table::decode_table(const std::vector<std::pair<char, ull>> &codes) : decode_table(codes.data(), codes.size()) {}
+
+decode_table::decode_table(const std::pair<char, ull> *codes, uint count) {
+    const uint root_size = 1u << root_bits;
+    for (uint i = 0; i < count; i++) {
+        max_len = std::max<uint>(max_len, (unsigned char) codes[i].first);
+    }
+    if (max_len > root_bits + max_sub_bits) {
+        ok = false;
+        return;
+    }
+
+    uint8_t sub_bits[root_size] = {};
+    for (uint i = 0; i < count; i++) {
+        uint len = (unsigned char) codes[i].first;
+        if (len > root_bits) {
+            ull prefix = huffman::rev(codes[i].second, len) & (root_size - 1);
+            sub_bits[prefix] = (uint8_t) std::max<uint>(sub_bits[prefix], len - root_bits);
+        }
+    }
+
+    uint size = root_size;
+    for (uint prefix = 0; prefix < root_size; prefix++) {
+        table[prefix] = entry();
+        if (sub_bits[prefix]) {
+            if (size + (1u << sub_bits[prefix]) > capacity) {
+                ok = false;
+                return;
+            }
+            table[prefix].value = (uint16_t) size;
+            table[prefix].sub_bits = sub_bits[prefix];
+            std::fill(table + size, table + size + (1u << sub_bits[prefix]), entry());
+            size += 1u << sub_bits[prefix];
+        }
+    }
+
+    for (uint i = 0; i < count; i++) {
+        uint len = (unsigned char) codes[i].first;
+        if (len == 0) {
+            continue;
+        }
+        ull code = huffman::rev(codes[i].second, len);
+        entry leaf = entry();
+        leaf.value = (uint16_t) i;
+        leaf.length = (uint8_t) len;
+        if (len <= root_bits) {
+            for (ull j = code; j < root_size; j += 1ull << len) {
+                table[j] = leaf;
+            }
+        } else {
+            entry const &link = table[code & (root_size - 1)];
+            uint sub_size = 1u << link.sub_bits;
+            for (ull j = code >> root_bits; j < sub_size; j += 1ull << (len - root_bits)) {
+                table[link.value + j] = leaf;
+            }
+        }
+    }
+}
+
+bool decode_table::valid() const {
+    return ok;
+}
+
+uint decode_table::max_length() const {
+    return max_len;
+}
@@ -0,0 +1,56 @@
+#ifndef HUFFMAN_DECODE_TABLE_H
+#define HUFFMAN_DECODE_TABLE_H
+
+#include <cstdint>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+#include <vector>
+
+// Two-level lookup table for LSB-first Huffman codes. The first level is
+// indexed by the next root_bits bits of the stream; codes longer than that
+// point into a second-level table indexed by the bits that follow.
+class decode_table {
+public:
+    static const uint root_bits = 11;
+    static const uint max_sub_bits = 12;
+
+    // Room for codes of up to 15 bits over 288 symbols; deeper code sets fit
+    // as long as their second-level tables do
+    static const uint capacity = (1u << root_bits) + 288 * (1u << (15 - root_bits));
+
+    explicit decode_table(const std::vector<std::pair<char, ull>> &codes);
+
+    // Codes of length 0 are unused; no heap allocation
+    decode_table(const std::pair<char, ull> *codes, uint count);
+
+    // False if some code is longer than root_bits + max_sub_bits or the
+    // second-level tables exceed capacity
+    bool valid() const;
+
+    uint max_length() const;
+
+    // Decodes the symbol at the bottom of bits and returns its code length,
+    // or 0 if the bits do not start with a valid code
+    uint decode(ull bits, uint &symbol) const {
+        entry e = table[bits & ((1u << root_bits) - 1)];
+        if (e.sub_bits) {
+            e = table[e.value + ((bits >> root_bits) & ((1u << e.sub_bits) - 1))];
+        }
+        symbol = e.value;
+        return e.length;
+    }
+
+private:
+    struct entry {
+        uint16_t value;
+        uint8_t length;
+        uint8_t sub_bits;
+    };
+
+    entry table[capacity];
+    uint max_len = 0;
+    bool ok = true;
+};
+
+#endif //HUFFMAN_DECODE_TABLE_H
@@ -0,0 +1,73 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Keeps every 32-bit counter below overflow
+    const size_t max_chunk = (size_t) 1 << 30;
+
+    // Below this a thread costs more than the bytes it would count
+    const size_t min_slice = (size_t) 1 << 20;
+
+    void count_chunk(const unsigned char *data, size_t size, ull *cnt) {
+        uint table[histogram::tables][256] = {};
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            ull word;
+            memcpy(&word, data + i, sizeof(word));
+            table[0][word & 0xff]++;
+            table[1][(word >> 8) & 0xff]++;
+            table[2][(word >> 16) & 0xff]++;
+            table[3][(word >> 24) & 0xff]++;
+            table[0][(word >> 32) & 0xff]++;
+            table[1][(word >> 40) & 0xff]++;
+            table[2][(word >> 48) & 0xff]++;
+            table[3][word >> 56]++;
+        }
+        for (; i < size; i++) {
+            table[0][data[i]]++;
+        }
+        for (uint c = 0; c < 256; c++) {
+            cnt[c] += (ull) table[0][c] + table[1][c] + table[2][c] + table[3][c];
+        }
+    }
+}
+
+void histogram::count(const unsigned char *data, size_t size, ull *cnt) {
+    for (size_t i = 0; i < size; i += max_chunk) {
+        count_chunk(data + i, std::min(max_chunk, size - i), cnt);
+    }
+}
+
+void histogram::count(const unsigned char *data, size_t size, ull *cnt, uint threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = (uint) std::min<size_t>(threads, size / min_slice);
+    if (threads <= 1) {
+        count(data, size, cnt);
+        return;
+    }
+
+    size_t slice = (size + threads - 1) / threads;
+    std::vector<ull> partial((threads - 1) * 256, 0);
+    std::vector<std::thread> pool;
+    for (uint t = 1; t < threads; t++) {
+        size_t from = t * slice;
+        pool.emplace_back([=, &partial] {
+            count(data + from, std::min(slice, size - from), &partial[(t - 1) * 256]);
+        });
+    }
+    count(data, slice, cnt);
+    for (auto &t : pool) {
+        t.join();
+    }
+    for (uint t = 0; t + 1 < threads; t++) {
+        for (uint c = 0; c < 256; c++) {
+            cnt[c] += partial[t * 256 + c];
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef HUFFMAN_HISTOGRAM_H
+#define HUFFMAN_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+// Byte frequency counting. Neighbouring bytes are counted in separate
+// tables that are summed at the end, so a run of one value does not wait on
+// the store of its own previous increment.
+namespace histogram {
+    const uint tables = 4;
+
+    // Adds the byte counts of data to cnt[256]
+    void count(const unsigned char *data, size_t size, ull *cnt);
+
+    // Same, split into one slice per thread; threads == 0 means one per
+    // hardware thread. Inputs too small to pay for the threads are counted
+    // on the calling thread.
+    void count(const unsigned char *data, size_t size, ull *cnt, uint threads);
+}
+
+#endif //HUFFMAN_HISTOGRAM_H
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+// Usage: histogram_bench [--size BYTES] [--threads N] [--min-time-ms N]
+//
+// Times the single-counter loop against histogram::count on the corpora of
+// the one_char_text and two_chars_text tests and on uniform random bytes.
+
+namespace {
+    ull sink;
+
+    double measure(double min_time_ms, std::function<void()> const &f) {
+        typedef std::chrono::steady_clock clock;
+        size_t iterations = 0;
+        clock::time_point start = clock::now();
+        double elapsed_ns = 0;
+        for (size_t batch = 1; elapsed_ns < min_time_ms * 1e6; batch *= 2) {
+            for (size_t i = 0; i < batch; i++) {
+                f();
+            }
+            iterations += batch;
+            elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        }
+        return elapsed_ns / iterations;
+    }
+
+    void naive(const unsigned char *data, size_t size, ull *cnt) {
+        for (size_t j = 0; j < size; j++) {
+            cnt[data[j]]++;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = 10 * 1024 * 1024;
+    uint threads = 0;
+    double min_time_ms = 200;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        if (option == "--size") {
+            size = std::strtoull(argv[i + 1], nullptr, 10);
+        } else if (option == "--threads") {
+            threads = (uint) std::strtoul(argv[i + 1], nullptr, 10);
+        } else if (option == "--min-time-ms") {
+            min_time_ms = std::atof(argv[i + 1]);
+        } else {
+            std::fprintf(stderr, "Usage: <histogram_bench> [--size BYTES] [--threads N] [--min-time-ms N]\n");
+            return 1;
+        }
+    }
+
+    std::mt19937 rnd(1);
+    std::vector<unsigned char> one_char(size, 'a'), two_chars(size), random(size);
+    for (size_t i = 0; i < size; i++) {
+        two_chars[i] = (unsigned char) ('a' + rnd() % 2);
+        random[i] = (unsigned char) rnd();
+    }
+    struct corpus {
+        const char *name;
+        const std::vector<unsigned char> *data;
+    } corpora[] = {{"one_char", &one_char}, {"two_chars", &two_chars}, {"random", &random}};
+
+    for (auto const &c : corpora) {
+        const unsigned char *data = c.data->data();
+        auto run = [&](const char *kernel, std::function<void(ull *)> const &f) {
+            double ns = measure(min_time_ms, [&] {
+                ull cnt[256] = {};
+                f(cnt);
+                sink += cnt[data[0]];
+            });
+            std::printf("%-10s %-10s %10.1f MB/s\n", c.name, kernel, size * 1e3 / ns);
+            std::fflush(stdout);
+        };
+        run("naive", [&](ull *cnt) { naive(data, size, cnt); });
+        run("tables", [&](ull *cnt) { histogram::count(data, size, cnt); });
+        run("threads", [&](ull *cnt) { histogram::count(data, size, cnt, threads); });
+    }
+    return sink == 0;
+}
@@ -1,89 +1,1365 @@
 #include "sstream"
 #include <vector>
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <queue>
 #include <cstring>
 #include "huffman.h"
 #include "trie.h"
+#include "decode_table.h"
+#include "histogram.h"
+#include "lz77.h"
+#include "tans.h"
+#include "bit_reader.h"
+#include "bit_writer.h"
+#include "block_pipeline.h"
 
 const uint huffman::buff_size = 4096;
 const uint huffman::len = 256;
+const uint huffman::max_code_len = 15;
+const char huffman::magic[4] = {'H', 'U', 'F', 2};
+const uint huffman::block_size = 1 << 17;
+const uint huffman::max_block_size = 1 << 22;
 
-void huffman::compress(std::istream &in, std::ostream &out) {
-    in.seekg(std::istream::beg);
+namespace {
+    // Trie decoding for code lengths the lookup table does not cover,
+    // trie::walk_bits bits per step
+    bool decode_bits(std::istream &in, std::ostream &out,
+                     const std::vector<std::pair<char, ull>> &codes, ull len_stream) {
+        trie code_trie(codes);
+        if (!code_trie.valid()) {
+            return false;
+        }
 
-    unsigned char buffer[buff_size];
-    unsigned char out_buffer[buff_size];
-    std::vector<ull> cnt(len);
+        unsigned char buffer[huffman::buff_size];
+        unsigned char out_buffer[huffman::buff_size];
+
+        uint buff_ind = 0;
+        auto write = [&](unsigned char x) {
+            if (buff_ind == huffman::buff_size) {
+                out.write((char *) out_buffer, buff_ind);
+                buff_ind = 0;
+            }
+            out_buffer[buff_ind++] = x;
+        };
+        // Bits past the end of the input read as zeros, so the last step
+        // must not use more bits than are left
+        auto step = [&](bit_reader &reader) {
+            uint used = code_trie.step((uint) reader.peek());
+            if (used == 0 || used > len_stream || used > reader.available()) {
+                return false;
+            }
+            reader.consume(used);
+            len_stream -= used;
+            if (code_trie.end()) {
+                write(code_trie.get());
+                code_trie.init();
+            }
+            return true;
+        };
 
-    uint cur_size;
-    while ((cur_size = in.readsome((char *) buffer, buff_size)) > 0) {
-        for (size_t j = 0; j < cur_size; j++) {
-            cnt[buffer[j]]++;
+        bit_reader reader(buffer, buffer);
+        bool eof = false;
+        while (len_stream > 0) {
+            if (reader.bytes_left() < sizeof(ull) && !eof) {
+                size_t left = reader.bytes_left();
+                memmove(buffer, reader.position(), left);
+                in.read((char *) buffer + left, huffman::buff_size - left);
+                uint cur_size = in.gcount();
+                eof = (cur_size == 0);
+                reader.set_input(buffer, buffer + left + cur_size);
+                continue;
+            }
+            reader.refill();
+            while (len_stream > 0 && reader.available() >= trie::walk_bits) {
+                if (!step(reader)) {
+                    return false;
+                }
+            }
+            if (eof && len_stream > 0 && reader.available() < trie::walk_bits && !step(reader)) {
+                return false;
+            }
+        }
+        if (buff_ind) {
+            out.write((char *) out_buffer, buff_ind);
         }
+        return true;
     }
 
-    uint buff_ind = 0;
-    ull len_stream = 0;
-    out.write((char *) &len_stream, sizeof(len_stream));
+    // Byte values plus the length codes of LZ blocks
+    const uint max_symbols = 288;
+    const uint max_levels = 64;
 
-    auto write = [&](auto x) {
-        if (buff_ind + sizeof(x) >= buff_size) {
-            out.write((char *) out_buffer, buff_ind);
-            buff_ind = 0;
+    // Working arrays of package_merge for n symbols: the leaf order, two
+    // levels of weights of 2n items each and, per level, a bit set of
+    // words words marking the leaves among its items
+    struct merge_scratch {
+        uint *order;
+        ull *weight[2];
+        ull *leaf_bits;
+        uint words;
+    };
+
+    // Package-merge. Level 0 lists the leaves by weight; every further level
+    // pairs up the items of the level below into packages and merges them
+    // back with the leaves, remembering which positions hold leaves. The
+    // cheapest 2n - 2 items of the top level then give each leaf one bit per
+    // occurrence: a prefix of a level holds some leaves and the packages made
+    // from a prefix twice as long below it.
+    void package_merge(const ull *cnt, uint n, uint max_len, unsigned char *lengths, const merge_scratch &scratch) {
+        uint *order = scratch.order;
+        uint leaves = 0;
+        for (uint i = 0; i < n; i++) {
+            lengths[i] = 0;
+            if (cnt[i]) {
+                order[leaves++] = i;
+            }
+        }
+        if (leaves <= 1) {
+            if (leaves == 1) {
+                lengths[order[0]] = 1;
+            }
+            return;
+        }
+        std::sort(order, order + leaves, [&](uint a, uint b) {
+            return cnt[a] != cnt[b] ? cnt[a] < cnt[b] : a < b;
+        });
+        // 2^63 covers any count of leaves, so the shift stays in range
+        max_len = std::min(max_len, max_levels - 1);
+        while ((1ull << max_len) < leaves) {
+            max_len++;
+        }
+        max_len = std::min(std::min(max_len, leaves - 1), max_levels);
+
+        uint size = leaves;
+        for (uint i = 0; i < leaves; i++) {
+            scratch.weight[0][i] = cnt[order[i]];
+        }
+        for (uint level = 1; level < max_len; level++) {
+            const ull *prev = scratch.weight[(level - 1) & 1];
+            ull *cur = scratch.weight[level & 1];
+            ull *leaf_bits = scratch.leaf_bits + level * scratch.words;
+            std::fill(leaf_bits, leaf_bits + scratch.words, 0);
+            uint packages = size / 2, i = 0, j = 0;
+            for (size = 0; i < leaves || j < packages; size++) {
+                if (j == packages || (i < leaves && cnt[order[i]] <= prev[2 * j] + prev[2 * j + 1])) {
+                    cur[size] = cnt[order[i++]];
+                    leaf_bits[size / 64] |= 1ull << (size % 64);
+                } else {
+                    cur[size] = prev[2 * j] + prev[2 * j + 1];
+                    j++;
+                }
+            }
+        }
+
+        uint take = 2 * leaves - 2;
+        for (uint level = max_len; level-- > 0;) {
+            uint taken_leaves = take;
+            if (level > 0) {
+                taken_leaves = 0;
+                const ull *leaf_bits = scratch.leaf_bits + level * scratch.words;
+                for (uint k = 0; k < take; k++) {
+                    taken_leaves += (leaf_bits[k / 64] >> (k % 64)) & 1u;
+                }
+            }
+            for (uint k = 0; k < taken_leaves; k++) {
+                lengths[order[k]]++;
+            }
+            take = 2 * (take - taken_leaves);
+        }
+    }
+
+    // Blocks never have more than max_symbols symbols, so their scratch
+    // lives on the stack; larger alphabets from code_lengths use the heap
+    void package_merge(const ull *cnt, uint n, uint max_len, unsigned char *lengths) {
+        if (n <= max_symbols) {
+            const uint words = 2 * max_symbols / 64;
+            uint order[max_symbols];
+            ull weight[2][2 * max_symbols];
+            ull leaf_bits[max_levels * words];
+            package_merge(cnt, n, max_len, lengths, {order, {weight[0], weight[1]}, leaf_bits, words});
+            return;
+        }
+        const uint words = (2 * n + 63) / 64;
+        std::vector<uint> order(n);
+        std::vector<ull> weight(2 * 2 * (size_t) n), leaf_bits((size_t) max_levels * words);
+        package_merge(cnt, n, max_len, lengths, {order.data(), {weight.data(), weight.data() + 2 * (size_t) n},
+                                                 leaf_bits.data(), words});
+    }
+
+    void canonical_codes(const unsigned char *lengths, uint n, std::pair<char, ull> *codes) {
+        ull next[max_levels + 1] = {};
+        for (uint i = 0; i < n; i++) {
+            if (lengths[i] <= max_levels) {
+                next[lengths[i]]++;
+            }
+        }
+        next[0] = 0;
+        ull cur_code = 0;
+        for (uint bits = 1; bits <= max_levels; bits++) {
+            ull count = next[bits];
+            next[bits] = cur_code;
+            cur_code = (cur_code + count) << 1;
+        }
+        for (uint i = 0; i < n; i++) {
+            bool coded = lengths[i] && lengths[i] <= max_levels;
+            codes[i] = {(char) lengths[i], coded ? next[lengths[i]]++ : 0};
+        }
+    }
+
+    bool kraft_fits(const unsigned char *lengths, uint n) {
+        const ull one = 1ull << huffman::max_code_len;
+        ull kraft = 0;
+        for (uint i = 0; i < n; i++) {
+            if (lengths[i] > huffman::max_code_len) {
+                return false;
+            }
+            if (lengths[i]) {
+                kraft += one >> lengths[i];
+            }
+        }
+        return kraft <= one;
+    }
+
+    const unsigned char end_block = 0;
+    const unsigned char huffman_block = 1;
+    const unsigned char interleaved_block = 2;
+    const unsigned char raw_block = 3;
+    const unsigned char rle_block = 4;
+    const unsigned char context_block = 5;
+    const unsigned char lz_block = 6;
+    const unsigned char tans_block = 7;
+
+    bool coded(unsigned char type) {
+        return type == huffman_block || type == interleaved_block;
+    }
+
+    // Reversed codes ready to be shifted into an LSB-first stream
+    struct encode_table {
+        ull code[max_symbols];
+        uint length[max_symbols];
+
+        encode_table() = default;
+
+        explicit encode_table(const unsigned char *lengths, uint n = huffman::len) {
+            assign(lengths, n);
+        }
+
+        void assign(const unsigned char *lengths, uint n = huffman::len) {
+            std::pair<char, ull> codes[max_symbols];
+            canonical_codes(lengths, n, codes);
+            for (uint i = 0; i < n; i++) {
+                length[i] = (unsigned char) codes[i].first;
+                code[i] = huffman::rev(codes[i].second, codes[i].first);
+            }
         }
-        memcpy(out_buffer + buff_ind, &x, sizeof(x));
-        buff_ind += sizeof(x);
-        len_stream += 8 * sizeof(x);
     };
 
-    for (uint i = 0; i < len; i++) {
-        write(static_cast<unsigned char>(i));
-        write(cnt[i]);
+    // Writes the codes of data to out and returns the number of bytes used;
+    // out needs 8 bytes of slack
+    size_t encode_block(const unsigned char *data, size_t size, const encode_table &table, unsigned char *out) {
+        // 3 codes of at most 15 bits plus 7 pending bits fit the 56 a flush allows
+        const uint per_flush = (56 - 7) / huffman::max_code_len;
+        bit_writer writer(out);
+        size_t j = 0;
+        for (; j + per_flush <= size; j += per_flush) {
+            for (uint k = 0; k < per_flush; k++) {
+                writer.put(table.code[data[j + k]], table.length[data[j + k]]);
+            }
+            writer.flush();
+        }
+        for (; j < size; j++) {
+            writer.put(table.code[data[j]], table.length[data[j]]);
+            writer.flush();
+        }
+        return writer.finish();
+    }
+
+    // Decodes count symbols, leaving the reader just past the last one
+    bool decode_symbols(const decode_table &table, bit_reader &reader, unsigned char *out, size_t count) {
+        uint max_len = table.max_length();
+        size_t i = 0;
+        while (i < count) {
+            reader.refill();
+            if (reader.available() < max_len) {
+                uint symbol;
+                uint length = table.decode(reader.peek(), symbol);
+                if (length == 0 || length > reader.available()) {
+                    return false;
+                }
+                reader.consume(length);
+                out[i++] = (unsigned char) symbol;
+                continue;
+            }
+            while (i < count && reader.available() >= max_len) {
+                uint symbol;
+                uint length = table.decode(reader.peek(), symbol);
+                if (length == 0) {
+                    return false;
+                }
+                reader.consume(length);
+                out[i++] = (unsigned char) symbol;
+            }
+        }
+        return true;
+    }
+
+    bool decode_block(const decode_table &table, const unsigned char *data, size_t size,
+                      unsigned char *out, size_t count) {
+        bit_reader reader(data, data + size);
+        return decode_symbols(table, reader, out, count);
     }
-    len_stream = 0;
 
-    auto codes = code(cnt);
-    in.seekg(std::istream::beg);
+    // Stream i of an interleaved block holds the symbols [i * segment, (i + 1) * segment)
+    size_t segment_size(size_t size, uint streams) {
+        return (size + streams - 1) / streams;
+    }
 
-    ull cur_out = 0;
-    uint cur_cnt = 0;
+    // Decodes Streams independent bitstreams in lockstep so their table
+    // lookups overlap, then finishes each stream on its own
+    template<uint Streams>
+    bool decode_interleaved(const decode_table &table, const unsigned char *const *data,
+                            unsigned char *out, size_t count) {
+        size_t segment = segment_size(count, Streams);
+        bit_reader reader[Streams];
+        unsigned char *dst[Streams];
+        unsigned char *dst_end[Streams];
+        for (uint i = 0; i < Streams; i++) {
+            reader[i].set_input(data[i], data[i + 1]);
+            dst[i] = out + std::min(count, i * segment);
+            dst_end[i] = out + std::min(count, (i + 1) * segment);
+        }
 
-    while ((cur_size = in.readsome((char *) buffer, buff_size)) > 0) {
-        for (size_t j = 0; j < cur_size; j++) {
-            auto crev = rev(codes[buffer[j]].second, codes[buffer[j]].first);
-            cur_out |= crev << cur_cnt;
-            cur_cnt += codes[buffer[j]].first;
-            if (cur_cnt >= 64) {
-                write(cur_out);
-                cur_cnt -= 64;
-                cur_out = crev >> (codes[buffer[j]].first - cur_cnt);
+        uint max_len = std::max(1u, table.max_length());
+        uint per_refill = 56 / max_len;
+        bool ok = true;
+        while (ok) {
+            bool fast = true;
+            for (uint i = 0; i < Streams; i++) {
+                fast &= reader[i].bytes_left() >= sizeof(ull) && (size_t) (dst_end[i] - dst[i]) >= per_refill;
+            }
+            if (!fast) {
+                break;
+            }
+            for (uint i = 0; i < Streams; i++) {
+                reader[i].refill();
+            }
+            for (uint k = 0; k < per_refill; k++) {
+                for (uint i = 0; i < Streams; i++) {
+                    uint symbol;
+                    uint length = table.decode(reader[i].peek(), symbol);
+                    ok &= (length != 0);
+                    reader[i].consume(length);
+                    *dst[i]++ = (unsigned char) symbol;
+                }
             }
         }
+        for (uint i = 0; i < Streams && ok; i++) {
+            ok = decode_symbols(table, reader[i], dst[i], dst_end[i] - dst[i]);
+        }
+        return ok;
     }
-    if (cur_cnt) {
-        write(cur_out);
-        len_stream -= (64 - cur_cnt);
+
+    const uint max_streams = 8;
+
+    // Rounds a requested stream count to one the format has: 1, 4 or 8
+    uint stream_count(uint streams) {
+        return streams > 4 ? 8 : streams > 1 ? 4 : 1;
     }
-    if (buff_ind) {
-        out.write((char *) out_buffer, buff_ind);
+
+    size_t payload_bound(size_t size) {
+        return size * huffman::max_code_len / 8 + 1 + max_streams * (sizeof(ull) + sizeof(uint));
+    }
+
+    // Every block starts with its type, raw size and payload size; coded
+    // blocks follow that with their packed code lengths
+    const size_t block_prefix_size = 1 + 2 * sizeof(uint);
+    const size_t block_header_size = block_prefix_size + huffman::len / 2;
+
+    size_t header_size(unsigned char type) {
+        return coded(type) ? block_header_size : block_prefix_size;
+    }
+
+    // Room write_block needs: a block is never larger than stored raw, but
+    // the bit writer may touch 8 bytes past its end
+    size_t block_bound(size_t size) {
+        return block_prefix_size + size + sizeof(ull);
+    }
+
+    // No prefix code beats the entropy of the histogram, so this is a lower
+    // bound on the coded payload in bytes
+    double entropy_bytes(const ull *cnt, size_t size) {
+        double bits = 0;
+        for (uint i = 0; i < huffman::len; i++) {
+            if (cnt[i]) {
+                bits += cnt[i] * std::log2((double) size / cnt[i]);
+            }
+        }
+        return bits / 8;
+    }
+
+    // Coding has to save at least 1/64 of a block to be worth decoding
+    size_t min_gain(size_t size) {
+        return size / 64;
+    }
+
+    void write_prefix(unsigned char type, uint size, uint payload_size, unsigned char *out) {
+        out[0] = type;
+        memcpy(out + 1, &size, sizeof(size));
+        memcpy(out + 1 + sizeof(size), &payload_size, sizeof(payload_size));
+    }
+
+    size_t write_stored_block(unsigned char type, const unsigned char *data, uint size, uint payload_size,
+                              unsigned char *out) {
+        write_prefix(type, size, payload_size, out);
+        memcpy(out + block_prefix_size, data, payload_size);
+        return block_prefix_size + payload_size;
+    }
+
+    // Blocks smaller than this stay single-stream; the jump table would cost
+    // more than interleaving saves
+    const size_t min_interleaved_size = 1024;
+
+    void unpack_lengths(const unsigned char *packed, unsigned char *lengths, uint n = huffman::len) {
+        for (uint i = 0; i < n; i += 2) {
+            lengths[i] = packed[i / 2] & 15u;
+            lengths[i + 1] = packed[i / 2] >> 4;
+        }
+    }
+
+    void pack_lengths(const unsigned char *lengths, unsigned char *packed, uint n = huffman::len) {
+        for (uint i = 0; i < n; i += 2) {
+            packed[i / 2] = (unsigned char) (lengths[i] | (lengths[i + 1] << 4));
+        }
+    }
+
+    // Context blocks code every byte with the table of the class of the byte
+    // before it. In text, what follows a letter, a digit, a space or a quote
+    // differs far more than what follows one letter or another, so a handful
+    // of classes gets most of the gain of one table per byte value.
+    const uint context_classes = 8;
+
+    const unsigned char *context_class() {
+        static const struct classes {
+            unsigned char of[huffman::len];
+
+            classes() {
+                for (uint c = 0; c < huffman::len; c++) {
+                    of[c] = c >= 0x80 ? 7 : c < ' ' ? 0 : c == ' ' ? 1 : (c >= '0' && c <= '9') ? 2 :
+                            (c >= 'a' && c <= 'z') ? 3 : (c >= 'A' && c <= 'Z') ? 4 :
+                            (c == '"' || c == '\'') ? 5 : strchr("{}[]():,;=", (int) c) ? 6 : 7;
+                }
+            }
+        } table;
+        return table.of;
+    }
+
+    // Code lengths per context class; the block starts in the class of byte 0
+    struct context_codes {
+        unsigned char lengths[context_classes][huffman::len];
+        unsigned char used = 0;
+        uint tables = 0;
+        ull bits = 0;
+
+        void build(const unsigned char *data, size_t size) {
+            ull cnt[context_classes][huffman::len] = {};
+            const unsigned char *cls = context_class();
+            unsigned char prev = 0;
+            for (size_t j = 0; j < size; j++) {
+                cnt[cls[prev]][data[j]]++;
+                prev = data[j];
+            }
+            for (uint c = 0; c < context_classes; c++) {
+                package_merge(cnt[c], huffman::len, huffman::max_code_len, lengths[c]);
+                for (uint i = 0; i < huffman::len; i++) {
+                    bits += cnt[c][i] * lengths[c][i];
+                    if (cnt[c][i]) {
+                        used |= (unsigned char) (1u << c);
+                    }
+                }
+                tables += (used >> c) & 1u;
+            }
+        }
+
+        // Mask of used classes, their packed lengths and the rounded-up stream
+        size_t payload_size() const {
+            return 1 + tables * huffman::len / 2 + (bits + 7) / 8 + 1;
+        }
+    };
+
+    size_t encode_context_block(const unsigned char *data, size_t size, const context_codes &model,
+                                unsigned char *out) {
+        encode_table tables[context_classes];
+        unsigned char *pos = out;
+        *pos++ = model.used;
+        for (uint c = 0; c < context_classes; c++) {
+            if ((model.used >> c) & 1u) {
+                tables[c].assign(model.lengths[c]);
+                pack_lengths(model.lengths[c], pos);
+                pos += huffman::len / 2;
+            }
+        }
+
+        const uint per_flush = (56 - 7) / huffman::max_code_len;
+        const unsigned char *cls = context_class();
+        bit_writer writer(pos);
+        unsigned char prev = 0;
+        auto put = [&](unsigned char c) {
+            const encode_table &table = tables[cls[prev]];
+            writer.put(table.code[c], table.length[c]);
+            prev = c;
+        };
+        size_t j = 0;
+        for (; j + per_flush <= size; j += per_flush) {
+            for (uint k = 0; k < per_flush; k++) {
+                put(data[j + k]);
+            }
+            writer.flush();
+        }
+        for (; j < size; j++) {
+            put(data[j]);
+            writer.flush();
+        }
+        return (pos - out) + writer.finish();
+    }
+
+    // Decodes with the table next[previous byte] picks, so switching tables
+    // is a lookup rather than a branch
+    bool decode_context_symbols(const decode_table *tables, const unsigned char *next, uint max_len,
+                                bit_reader &reader, unsigned char *out, size_t count) {
+        uint table = next[0];
+        size_t i = 0;
+        while (i < count) {
+            reader.refill();
+            if (reader.available() < max_len) {
+                uint symbol;
+                uint length = tables[table].decode(reader.peek(), symbol);
+                if (length == 0 || length > reader.available()) {
+                    return false;
+                }
+                reader.consume(length);
+                out[i++] = (unsigned char) symbol;
+                table = next[symbol];
+                continue;
+            }
+            while (i < count && reader.available() >= max_len) {
+                uint symbol;
+                uint length = tables[table].decode(reader.peek(), symbol);
+                if (length == 0) {
+                    return false;
+                }
+                reader.consume(length);
+                out[i++] = (unsigned char) symbol;
+                table = next[symbol];
+            }
+        }
+        return true;
+    }
+
+    bool decode_context_block(const unsigned char *data, size_t size, unsigned char *out, size_t count) {
+        if (size == 0) {
+            return false;
+        }
+        unsigned char used = data[0];
+        const unsigned char *pos = data + 1;
+        // Table 0 has no codes, so a byte of a class the block never uses
+        // fails the next lookup
+        std::vector<decode_table> tables;
+        tables.reserve(context_classes + 1);
+        std::pair<char, ull> codes[huffman::len] = {};
+        tables.emplace_back(codes, huffman::len);
+        unsigned char which[context_classes] = {};
+        uint max_len = 1;
+        for (uint c = 0; c < context_classes; c++) {
+            if (!((used >> c) & 1u)) {
+                continue;
+            }
+            unsigned char lengths[huffman::len];
+            if ((size_t) (data + size - pos) < huffman::len / 2) {
+                return false;
+            }
+            unpack_lengths(pos, lengths);
+            pos += huffman::len / 2;
+            if (!kraft_fits(lengths, huffman::len)) {
+                return false;
+            }
+            canonical_codes(lengths, huffman::len, codes);
+            tables.emplace_back(codes, huffman::len);
+            which[c] = (unsigned char) (tables.size() - 1);
+            max_len = std::max(max_len, tables.back().max_length());
+        }
+
+        const unsigned char *cls = context_class();
+        unsigned char next[huffman::len];
+        for (uint b = 0; b < huffman::len; b++) {
+            next[b] = which[cls[b]];
+        }
+        bit_reader reader(pos, data + size);
+        return decode_context_symbols(tables.data(), next, max_len, reader, out, count);
+    }
+
+    // LZ blocks code an lz77 parse deflate-style: literals and length codes
+    // share one table, distances have their own. The payload starts with
+    // both tables' packed lengths.
+    const uint lz_literal_symbols = huffman::len + lz77::length_codes;
+    const size_t lz_tables_size = (lz_literal_symbols + lz77::distance_codes) / 2;
+
+    uint match_length_value(uint token) {
+        return (token & ~lz77::match_flag) >> lz77::window_bits;
+    }
+
+    uint match_distance_value(uint token) {
+        return token & (lz77::max_window - 1);
+    }
+
+    struct lz_codes {
+        unsigned char literal[lz_literal_symbols];
+        unsigned char distance[lz77::distance_codes];
+        ull bits = 0;
+
+        void build(const std::vector<uint> &tokens) {
+            ull literal_cnt[lz_literal_symbols] = {}, distance_cnt[lz77::distance_codes] = {};
+            for (uint token : tokens) {
+                if (!(token & lz77::match_flag)) {
+                    literal_cnt[token]++;
+                    continue;
+                }
+                uint extra_bits, extra;
+                literal_cnt[huffman::len + lz77::bucket(match_length_value(token), extra_bits, extra)]++;
+                bits += extra_bits;
+                distance_cnt[lz77::bucket(match_distance_value(token), extra_bits, extra)]++;
+                bits += extra_bits;
+            }
+            package_merge(literal_cnt, lz_literal_symbols, huffman::max_code_len, literal);
+            package_merge(distance_cnt, lz77::distance_codes, huffman::max_code_len, distance);
+            for (uint i = 0; i < lz_literal_symbols; i++) {
+                bits += literal_cnt[i] * literal[i];
+            }
+            for (uint i = 0; i < lz77::distance_codes; i++) {
+                bits += distance_cnt[i] * distance[i];
+            }
+        }
+
+        size_t payload_size() const {
+            return lz_tables_size + (bits + 7) / 8 + 1;
+        }
+    };
+
+    size_t encode_lz_block(const std::vector<uint> &tokens, const lz_codes &model, unsigned char *out) {
+        pack_lengths(model.literal, out, lz_literal_symbols);
+        pack_lengths(model.distance, out + lz_literal_symbols / 2, lz77::distance_codes);
+        encode_table literal(model.literal, lz_literal_symbols);
+        encode_table distance(model.distance, lz77::distance_codes);
+
+        // A match takes at most 15 + 6 + 15 + 15 bits, which fit beside the
+        // 7 a flush leaves pending
+        bit_writer writer(out + lz_tables_size);
+        for (uint token : tokens) {
+            if (!(token & lz77::match_flag)) {
+                writer.put(literal.code[token], literal.length[token]);
+            } else {
+                uint extra_bits, extra;
+                uint code = huffman::len + lz77::bucket(match_length_value(token), extra_bits, extra);
+                writer.put(literal.code[code], literal.length[code]);
+                writer.put(extra, extra_bits);
+                code = lz77::bucket(match_distance_value(token), extra_bits, extra);
+                writer.put(distance.code[code], distance.length[code]);
+                writer.put(extra, extra_bits);
+            }
+            writer.flush();
+        }
+        return lz_tables_size + writer.finish();
+    }
+
+    // Reads a code, or extra bits, checking that the input held them
+    bool read_code(const decode_table &table, bit_reader &reader, uint &symbol) {
+        uint length = table.decode(reader.peek(), symbol);
+        if (length == 0 || length > reader.available()) {
+            return false;
+        }
+        reader.consume(length);
+        return true;
+    }
+
+    bool read_extra(bit_reader &reader, uint bits, uint &value) {
+        if (bits > reader.available()) {
+            return false;
+        }
+        value += (uint) reader.peek() & ((1u << bits) - 1);
+        reader.consume(bits);
+        return true;
     }
-    out.seekp(0);
-    out.write((char *) &len_stream, sizeof(len_stream));
+
+    bool decode_lz_block(const unsigned char *data, size_t size, unsigned char *out, size_t count) {
+        if (size < lz_tables_size) {
+            return false;
+        }
+        unsigned char literal_lengths[lz_literal_symbols], distance_lengths[lz77::distance_codes];
+        unpack_lengths(data, literal_lengths, lz_literal_symbols);
+        unpack_lengths(data + lz_literal_symbols / 2, distance_lengths, lz77::distance_codes);
+        if (!kraft_fits(literal_lengths, lz_literal_symbols) ||
+            !kraft_fits(distance_lengths, lz77::distance_codes)) {
+            return false;
+        }
+        std::pair<char, ull> codes[lz_literal_symbols];
+        canonical_codes(literal_lengths, lz_literal_symbols, codes);
+        decode_table literal(codes, lz_literal_symbols);
+        canonical_codes(distance_lengths, lz77::distance_codes, codes);
+        decode_table distance(codes, lz77::distance_codes);
+
+        // One refill covers a whole match while 8 bytes of input remain
+        bit_reader reader(data + lz_tables_size, data + size);
+        size_t pos = 0;
+        while (pos < count) {
+            reader.refill();
+            uint symbol;
+            if (!read_code(literal, reader, symbol)) {
+                return false;
+            }
+            if (symbol < huffman::len) {
+                out[pos++] = (unsigned char) symbol;
+                continue;
+            }
+            uint extra_bits, code;
+            uint length = lz77::min_match + lz77::bucket_base(symbol - huffman::len, extra_bits);
+            if (!read_extra(reader, extra_bits, length) || !read_code(distance, reader, code)) {
+                return false;
+            }
+            uint dist = 1 + lz77::bucket_base(code, extra_bits);
+            if (!read_extra(reader, extra_bits, dist) || dist > pos || length > count - pos) {
+                return false;
+            }
+            unsigned char *dst = out + pos;
+            const unsigned char *src = dst - dist;
+            if (dist >= length) {
+                memcpy(dst, src, length);
+            } else {
+                for (uint i = 0; i < length; i++) {
+                    dst[i] = src[i];
+                }
+            }
+            pos += length;
+        }
+        return true;
+    }
+
+    // A tANS payload starts with a bit mask of the symbols present and their
+    // normalized counts, 16 bits each in symbol order
+    const size_t tans_mask_size = huffman::len / 8;
+
+    size_t tans_tables_size(const uint16_t *norm) {
+        size_t res = tans_mask_size;
+        for (uint s = 0; s < huffman::len; s++) {
+            res += norm[s] ? sizeof(uint16_t) : 0;
+        }
+        return res;
+    }
+
+    // Writes the tables and the stream to out, using the room up to out_end
+    // to build the stream; returns the payload size, or 0 if it did not fit
+    size_t encode_tans_block(const unsigned char *data, uint size, const uint16_t *norm,
+                             unsigned char *out, unsigned char *out_end) {
+        memset(out, 0, tans_mask_size);
+        size_t pos = tans_mask_size;
+        for (uint s = 0; s < huffman::len; s++) {
+            if (norm[s]) {
+                out[s / 8] |= (unsigned char) (1u << (s % 8));
+                memcpy(out + pos, &norm[s], sizeof(norm[s]));
+                pos += sizeof(norm[s]);
+            }
+        }
+        size_t stream = tans::encode(data, size, norm, out + pos, out_end);
+        if (stream == 0) {
+            return 0;
+        }
+        memmove(out + pos, out_end - stream, stream);
+        return pos + stream;
+    }
+
+    bool decode_tans_block(const unsigned char *data, size_t size, unsigned char *out, size_t count) {
+        if (size < tans_mask_size) {
+            return false;
+        }
+        uint16_t norm[huffman::len];
+        size_t pos = tans_mask_size;
+        for (uint s = 0; s < huffman::len; s++) {
+            norm[s] = 0;
+            if ((data[s / 8] >> (s % 8)) & 1u) {
+                if (size - pos < sizeof(norm[s])) {
+                    return false;
+                }
+                memcpy(&norm[s], data + pos, sizeof(norm[s]));
+                pos += sizeof(norm[s]);
+            }
+        }
+        tans::decoder decoder;
+        return decoder.build(norm) && decoder.decode(data + pos, size - pos, out, count);
+    }
+
+    struct encode_options {
+        uint streams;
+        bool contexts;
+        uint level;
+    };
+
+    // Order-0 payload: one bitstream, or for an interleaved block the stream
+    // count, the byte sizes of all streams but the last and the streams
+    uint encode_huffman_payload(const unsigned char *data, uint size, const unsigned char *lengths, uint streams,
+                                unsigned char *payload) {
+        encode_table codes(lengths);
+        if (streams == 1) {
+            return encode_block(data, size, codes, payload);
+        }
+        payload[0] = (unsigned char) streams;
+        size_t segment = segment_size(size, streams);
+        uint payload_size = 1 + (streams - 1) * sizeof(uint);
+        for (uint i = 0; i < streams; i++) {
+            size_t from = std::min<size_t>(size, i * segment), to = std::min<size_t>(size, from + segment);
+            uint stream_size = encode_block(data + from, to - from, codes, payload + payload_size);
+            if (i + 1 < streams) {
+                memcpy(payload + 1 + i * sizeof(uint), &stream_size, sizeof(stream_size));
+            }
+            payload_size += stream_size;
+        }
+        return payload_size;
+    }
+
+    // Serializes one block: type, raw size, payload size, then for order-0
+    // blocks the packed code lengths, and the payload. A block of one
+    // repeated byte is stored as that byte. Otherwise the smallest of the
+    // enabled codings is written, or the block is stored raw if none saves
+    // min_gain. out needs room for block_bound(size) bytes; returns the bytes
+    // used.
+    size_t write_block(const unsigned char *data, uint size, const encode_options &options, unsigned char *out) {
+        ull cnt[huffman::len] = {};
+        histogram::count(data, size, cnt);
+        if (size > 0 && cnt[data[0]] == size) {
+            return write_stored_block(rle_block, data, size, 1, out);
+        }
+        size_t best = block_prefix_size + size - min_gain(size);
+        unsigned char type = raw_block;
+
+        std::vector<uint> tokens;
+        lz_codes lz;
+        if (options.level > 0) {
+            lz77::parse(data, size, lz77::level(options.level), tokens);
+            lz.build(tokens);
+            if (block_prefix_size + lz.payload_size() < best) {
+                best = block_prefix_size + lz.payload_size();
+                type = lz_block;
+            }
+        }
+
+        // No order-0 code beats the entropy, so skip building one that cannot win
+        unsigned char lengths[huffman::len];
+        uint streams = (size < min_interleaved_size ? 1 : options.streams);
+        context_codes contexts;
+        uint16_t norm[huffman::len];
+        if (block_header_size + entropy_bytes(cnt, size) < best) {
+            package_merge(cnt, huffman::len, huffman::max_code_len, lengths);
+            ull bits = 0;
+            for (uint i = 0; i < huffman::len; i++) {
+                bits += cnt[i] * lengths[i];
+            }
+            // Every stream rounds up to a whole byte
+            size_t coded_size = block_header_size + (streams > 1 ? 1 + (streams - 1) * sizeof(uint) : 0) +
+                                (bits + 7) / 8 + streams;
+            if (coded_size < best) {
+                best = coded_size;
+                type = (streams == 1 ? huffman_block : interleaved_block);
+            }
+            // tANS spends fractional bits per symbol, which pays where one
+            // symbol dominates. It decodes slower than interleaved streams,
+            // so it has to save min_gain over them too. The estimate allows
+            // for the final states.
+            if (tans::normalize(cnt, norm)) {
+                size_t tans_size = block_prefix_size + tans_tables_size(norm) +
+                                   (size_t) (tans::cost_bits(cnt, norm) / 8) + 4 * tans::table_log / 8 + 2;
+                if (tans_size + min_gain(size) < best) {
+                    best = tans_size;
+                    type = tans_block;
+                }
+            }
+        }
+
+        // Context codes can beat the order-0 entropy, so they are tried
+        // whatever the bound above says
+        if (options.contexts) {
+            contexts.build(data, size);
+            if (block_prefix_size + contexts.payload_size() < best) {
+                best = block_prefix_size + contexts.payload_size();
+                type = context_block;
+            }
+        }
+
+        uint payload_size;
+        if (type == raw_block) {
+            return write_stored_block(raw_block, data, size, size, out);
+        } else if (type == lz_block) {
+            payload_size = encode_lz_block(tokens, lz, out + block_prefix_size);
+        } else if (type == context_block) {
+            payload_size = encode_context_block(data, size, contexts, out + block_prefix_size);
+        } else if (type == tans_block) {
+            payload_size = encode_tans_block(data, size, norm, out + block_prefix_size, out + block_bound(size));
+            // The estimate is not a bound; a block must never outgrow raw
+            if (payload_size == 0 || payload_size > size) {
+                return write_stored_block(raw_block, data, size, size, out);
+            }
+        } else {
+            pack_lengths(lengths, out + block_prefix_size);
+            payload_size = encode_huffman_payload(data, size, lengths, streams, out + block_header_size);
+        }
+        write_prefix(type, size, payload_size, out);
+        return header_size(type) + payload_size;
+    }
+
+    // Splits an interleaved payload along its jump table and decodes it
+    bool decode_interleaved_block(const decode_table &table, const unsigned char *data, size_t size,
+                                  unsigned char *out, size_t count) {
+        if (size == 0) {
+            return false;
+        }
+        uint streams = data[0];
+        size_t table_size = 1 + (streams - 1) * sizeof(uint);
+        if ((streams != 4 && streams != 8) || size < table_size) {
+            return false;
+        }
+        const unsigned char *bounds[max_streams + 1];
+        bounds[0] = data + table_size;
+        for (uint i = 0; i + 1 < streams; i++) {
+            uint stream_size;
+            memcpy(&stream_size, data + 1 + i * sizeof(uint), sizeof(stream_size));
+            if (stream_size > (size_t) (data + size - bounds[i])) {
+                return false;
+            }
+            bounds[i + 1] = bounds[i] + stream_size;
+        }
+        bounds[streams] = data + size;
+        return streams == 4 ? decode_interleaved<4>(table, bounds, out, count)
+                            : decode_interleaved<8>(table, bounds, out, count);
+    }
+
+    struct compress_slot {
+        std::vector<unsigned char> input, output;
+        const unsigned char *data = nullptr;
+        uint size = 0;
+    };
+
+    void encode_slot(compress_slot &slot, const encode_options &options) {
+        slot.output.resize(block_bound(slot.size));
+        slot.output.resize(write_block(slot.data, slot.size, options, slot.output.data()));
+    }
+
+    bool decode_payload(unsigned char type, const unsigned char *lengths,
+                        const unsigned char *payload, size_t payload_size, unsigned char *out, size_t size) {
+        if (type == raw_block) {
+            memcpy(out, payload, size);
+            return true;
+        }
+        if (type == rle_block) {
+            memset(out, payload[0], size);
+            return true;
+        }
+        if (type == context_block) {
+            return decode_context_block(payload, payload_size, out, size);
+        }
+        if (type == lz_block) {
+            return decode_lz_block(payload, payload_size, out, size);
+        }
+        if (type == tans_block) {
+            return decode_tans_block(payload, payload_size, out, size);
+        }
+        if (!kraft_fits(lengths, huffman::len)) {
+            return false;
+        }
+        std::pair<char, ull> codes[huffman::len];
+        canonical_codes(lengths, huffman::len, codes);
+        decode_table table(codes, huffman::len);
+        auto decode = (type == interleaved_block ? decode_interleaved_block : decode_block);
+        return decode(table, payload, payload_size, out, size);
+    }
+
+    bool valid_block_header(unsigned char type, uint size, uint payload_size) {
+        if (size > huffman::max_block_size) {
+            return false;
+        }
+        if (type == raw_block) {
+            return payload_size == size;
+        }
+        if (type == rle_block) {
+            return payload_size == 1 && size > 0;
+        }
+        if (type == context_block) {
+            return payload_size <= 1 + context_classes * huffman::len / 2 + payload_bound(size);
+        }
+        if (type == lz_block) {
+            return payload_size <= lz_tables_size + payload_bound(size);
+        }
+        if (type == tans_block) {
+            return payload_size <= tans_mask_size + huffman::len * sizeof(uint16_t) + payload_bound(size);
+        }
+        return coded(type) && payload_size <= payload_bound(size);
+    }
+
+    // A block inside a buffer
+    struct block_view {
+        unsigned char type;
+        uint size, payload_size;
+        const unsigned char *begin, *lengths, *payload;
+    };
+
+    // Parses the block at pos and moves past it; returns false at the end
+    // marker, which sets end, or on a malformed block
+    bool parse_block(const unsigned char *&pos, const unsigned char *end_pos, block_view &view, bool &end) {
+        if (pos == end_pos || *pos == end_block) {
+            end = (pos != end_pos);
+            return false;
+        }
+        view.type = pos[0];
+        size_t header = header_size(view.type);
+        if ((size_t) (end_pos - pos) < header) {
+            return false;
+        }
+        memcpy(&view.size, pos + 1, sizeof(view.size));
+        memcpy(&view.payload_size, pos + 1 + sizeof(view.size), sizeof(view.payload_size));
+        if (!valid_block_header(view.type, view.size, view.payload_size) ||
+            view.payload_size > (size_t) (end_pos - pos) - header) {
+            return false;
+        }
+        view.begin = pos;
+        view.lengths = pos + block_prefix_size;
+        view.payload = pos + header;
+        pos += header + view.payload_size;
+        return true;
+    }
+
+    struct decompress_slot {
+        unsigned char lengths[huffman::len];
+        std::vector<unsigned char> payload, output;
+        unsigned char type = huffman_block;
+        bool ok = false;
+    };
+
+    template<typename T>
+    bool read_value(std::istream &in, T &x) {
+        in.read((char *) &x, sizeof(x));
+        return in.gcount() == sizeof(x);
+    }
+
+    // Reads the next block into slot; returns false at the end marker, which
+    // sets end, or on a malformed block
+    bool read_block(std::istream &in, decompress_slot &slot, bool &end) {
+        unsigned char type;
+        uint size, payload_size;
+        if (!read_value(in, type) || type == end_block) {
+            end = (in.gcount() == sizeof(type));
+            return false;
+        }
+        if (!read_value(in, size) || !read_value(in, payload_size) || !valid_block_header(type, size, payload_size)) {
+            return false;
+        }
+        if (coded(type)) {
+            unsigned char packed[huffman::len / 2];
+            if (!read_value(in, packed)) {
+                return false;
+            }
+            unpack_lengths(packed, slot.lengths);
+        }
+        slot.type = type;
+
+        slot.payload.resize(payload_size);
+        slot.output.resize(size);
+        in.read((char *) slot.payload.data(), payload_size);
+        return in.gcount() == payload_size;
+    }
+
+    void decode_slot(decompress_slot &slot) {
+        slot.ok = decode_payload(slot.type, slot.lengths, slot.payload.data(), slot.payload.size(),
+                                 slot.output.data(), slot.output.size());
+    }
+
+    // The index follows the end marker: (raw offset, file offset) of every
+    // block, the number of blocks and index_tag
+    const char index_tag[4] = {'H', 'I', 'D', 'X'};
+    const size_t index_trailer_size = sizeof(ull) + sizeof(index_tag);
+
+    bool read_index(std::istream &in, std::vector<std::pair<ull, ull>> &index) {
+        char tag[sizeof(index_tag)];
+        ull count;
+        if (!in.seekg(-(std::streamoff) index_trailer_size, std::istream::end) || !read_value(in, count) ||
+            !in.read(tag, sizeof(tag)) || memcmp(tag, index_tag, sizeof(tag)) != 0) {
+            return false;
+        }
+        std::streamoff end = in.tellg();
+        if (count > (ull) end / (2 * sizeof(ull))) {
+            return false;
+        }
+        index.resize(count);
+        in.seekg(end - (std::streamoff) (index_trailer_size + count * 2 * sizeof(ull)));
+        for (auto &entry : index) {
+            if (!read_value(in, entry.first) || !read_value(in, entry.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// Every block carries its own code lengths, so the input is read once, a
+// block at a time, and nothing is patched after it has been written
+void huffman::compress(std::istream &in, std::ostream &out, uint threads, uint streams, bool contexts, uint level,
+                       uint buffers) {
+    out.write(magic, sizeof(magic));
+
+    encode_options options = {stream_count(streams), contexts, level};
+    std::vector<std::pair<ull, ull>> index;
+    ull raw_offset = 0, file_offset = sizeof(magic);
+    block_pipeline<compress_slot> pipeline(threads, buffers);
+    pipeline.run([&](compress_slot &slot) {
+        slot.input.resize(block_size);
+        in.read((char *) slot.input.data(), block_size);
+        slot.data = slot.input.data();
+        slot.size = in.gcount();
+        return slot.size > 0;
+    }, [&](compress_slot &slot) {
+        encode_slot(slot, options);
+    }, [&](compress_slot &slot) {
+        out.write((char *) slot.output.data(), slot.output.size());
+        index.push_back({raw_offset, file_offset});
+        raw_offset += slot.size;
+        file_offset += slot.output.size();
+        return true;
+    });
+    out.put(end_block);
+
+    for (auto const &entry : index) {
+        out.write((char *) &entry.first, sizeof(entry.first));
+        out.write((char *) &entry.second, sizeof(entry.second));
+    }
+    ull count = index.size();
+    out.write((char *) &count, sizeof(count));
+    out.write(index_tag, sizeof(index_tag));
+}
+
+size_t huffman::compress_bound(size_t size) {
+    size_t blocks = (size + block_size - 1) / block_size;
+    return sizeof(magic) + size + blocks * (block_prefix_size + 2 * sizeof(ull)) + 1 + index_trailer_size +
+           sizeof(ull);
+}
+
+size_t huffman::compress(const unsigned char *in, size_t size, unsigned char *out, uint threads, uint streams,
+                         bool contexts, uint level) {
+    encode_options options = {stream_count(streams), contexts, level};
+    memcpy(out, magic, sizeof(magic));
+    size_t pos = sizeof(magic);
+
+    if (threads == 1) {
+        for (size_t from = 0; from < size; from += block_size) {
+            pos += write_block(in + from, std::min<size_t>(block_size, size - from), options, out + pos);
+        }
+    } else {
+        size_t next = 0;
+        block_pipeline<compress_slot> pipeline(threads);
+        pipeline.run([&](compress_slot &slot) {
+            slot.data = in + next;
+            slot.size = std::min<size_t>(block_size, size - next);
+            next += slot.size;
+            return slot.size > 0;
+        }, [&](compress_slot &slot) {
+            encode_slot(slot, options);
+        }, [&](compress_slot &slot) {
+            memcpy(out + pos, slot.output.data(), slot.output.size());
+            pos += slot.output.size();
+            return true;
+        });
+    }
+    out[pos++] = end_block;
+
+    // Walk the written blocks again for the index rather than collecting it
+    // on the heap
+    ull count = 0, raw_offset = 0;
+    const unsigned char *block = out + sizeof(magic);
+    block_view view;
+    bool end;
+    while (parse_block(block, out + pos, view, end)) {
+        ull file_offset = view.begin - out;
+        memcpy(out + pos, &raw_offset, sizeof(raw_offset));
+        memcpy(out + pos + sizeof(ull), &file_offset, sizeof(file_offset));
+        pos += 2 * sizeof(ull);
+        raw_offset += view.size;
+        count++;
+    }
+    memcpy(out + pos, &count, sizeof(count));
+    memcpy(out + pos + sizeof(count), index_tag, sizeof(index_tag));
+    return pos + index_trailer_size;
+}
+
+void huffman::compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out,
+                       uint threads, uint streams, bool contexts, uint level) {
+    out.resize(compress_bound(size));
+    out.resize(compress(in, size, out.data(), threads, streams, contexts, level));
+}
+
+bool huffman::decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, uint threads) {
+    ull raw_size;
+    if (!decompressed_size(in, size, raw_size)) {
+        return false;
+    }
+    out.resize(raw_size);
+    return decompress(in, size, out.data(), out.size(), threads);
+}
+
+bool huffman::decompressed_size(const unsigned char *in, size_t size, ull &res) {
+    if (size < sizeof(magic) || memcmp(in, magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    const unsigned char *pos = in + sizeof(magic);
+    block_view view;
+    bool end = false;
+    res = 0;
+    while (parse_block(pos, in + size, view, end)) {
+        res += view.size;
+    }
+    return end;
+}
+
+bool huffman::decompress(const unsigned char *in, size_t size, unsigned char *out, size_t out_size, uint threads) {
+    if (size < sizeof(magic) || memcmp(in, magic, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    struct slot {
+        block_view view;
+        unsigned char lengths[len];
+        unsigned char *out;
+        bool ok;
+    };
+    const unsigned char *pos = in + sizeof(magic);
+    size_t written = 0;
+    bool end = false;
+    block_pipeline<slot> pipeline(threads);
+    bool ok = pipeline.run([&](slot &cur) {
+        if (!parse_block(pos, in + size, cur.view, end) || cur.view.size > out_size - written) {
+            return false;
+        }
+        cur.out = out + written;
+        written += cur.view.size;
+        return true;
+    }, [](slot &cur) {
+        if (coded(cur.view.type)) {
+            unpack_lengths(cur.view.lengths, cur.lengths);
+        }
+        cur.ok = decode_payload(cur.view.type, cur.lengths, cur.view.payload, cur.view.payload_size,
+                                cur.out, cur.view.size);
+    }, [](slot &cur) {
+        return cur.ok;
+    });
+    return ok && end && written == out_size;
 }
 
-bool huffman::decompress(std::istream &in, std::ostream &out) {
-    in.seekg(std::istream::beg);
+// Seeks to the first block covering offset through the index and decodes
+// only the blocks the range touches. Files without an index are decoded
+// from the first block, discarding what lies before the range.
+bool huffman::decompress_range(std::istream &in, ull offset, ull length, std::ostream &out) {
+    char head[sizeof(magic)];
+    if (!in.read(head, sizeof(head)) || memcmp(head, magic, sizeof(magic)) != 0) {
+        return false;
+    }
 
+    ull raw_offset = 0;
+    std::vector<std::pair<ull, ull>> index;
+    if (read_index(in, index)) {
+        auto it = std::upper_bound(index.begin(), index.end(), std::make_pair(offset, ~(ull) 0));
+        if (it != index.begin()) {
+            raw_offset = (--it)->first;
+            in.seekg(it->second);
+        } else {
+            in.seekg(sizeof(magic));
+        }
+    } else {
+        in.clear();
+        in.seekg(sizeof(magic));
+    }
+
+    decompress_slot slot;
+    bool end = false;
+    while (length > 0 && read_block(in, slot, end)) {
+        decode_slot(slot);
+        if (!slot.ok) {
+            return false;
+        }
+        ull size = slot.output.size();
+        if (offset < raw_offset + size) {
+            ull from = std::max(offset, raw_offset) - raw_offset;
+            ull count = std::min(length, size - from);
+            out.write((char *) slot.output.data() + from, count);
+            offset += count;
+            length -= count;
+        }
+        raw_offset += size;
+    }
+    return length == 0 || end;
+}
+
+bool huffman::decompress(std::istream &in, std::ostream &out, uint threads, uint buffers) {
+    char head[sizeof(magic)];
+    in.read(head, sizeof(head));
+    if (in.gcount() != sizeof(head) || memcmp(head, magic, sizeof(magic) - 1) != 0) {
+        return decompress_legacy(head, in.gcount(), in, out);
+    }
+    if (head[sizeof(magic) - 1] == 1) {
+        return decompress_single(in, out);
+    }
+    if (head[sizeof(magic) - 1] != magic[sizeof(magic) - 1]) {
+        return false;
+    }
+
+    bool end = false;
+    block_pipeline<decompress_slot> pipeline(threads, buffers);
+    bool ok = pipeline.run([&](decompress_slot &slot) {
+        return read_block(in, slot, end);
+    }, decode_slot, [&](decompress_slot &slot) {
+        if (slot.ok) {
+            out.write((char *) slot.output.data(), slot.output.size());
+        }
+        return slot.ok;
+    });
+    return ok && end;
+}
+
+// Version 1: one code for the whole input, the bit count patched in after
+// the data was written
+bool huffman::decompress_single(std::istream &in, std::ostream &out) {
     ull len_stream = 0;
     in.read((char *) &len_stream, sizeof(len_stream));
 
+    std::vector<unsigned char> lengths(len);
+    for (uint i = 0; i < len; i += 2) {
+        unsigned char packed;
+        if (!in.read((char *) &packed, sizeof(packed))) {
+            return false;
+        }
+        lengths[i] = packed & 15u;
+        lengths[i + 1] = packed >> 4;
+    }
+    if (!valid_lengths(lengths)) {
+        return false;
+    }
+    return decode(in, out, canonical(lengths), len_stream);
+}
+
+// Format written before canonical codes: the bit count followed by
+// (symbol, count) pairs for all 256 symbols, codes rebuilt from the counts
+bool huffman::decompress_legacy(const char *head, size_t head_size, std::istream &in, std::ostream &out) {
+    ull len_stream = 0;
+    memcpy(&len_stream, head, head_size);
+    in.read((char *) &len_stream + head_size, sizeof(len_stream) - head_size);
+
     std::vector<ull> cnt(len);
     for (uint i = 0; i < len; i++) {
         unsigned char num;
-        in.read((char *) &num, sizeof(num));
-        if (num != i) {
+        if (!in.read((char *) &num, sizeof(num)) || num != i) {
             return false;
         }
         ull val;
@@ -91,36 +1367,62 @@ bool huffman::decompress(std::istream &in, std::ostream &out) {
         cnt[num] = val;
     }
 
-    auto codes = code(cnt);
-    trie code_trie(codes);
+    return decode(in, out, code(cnt), len_stream);
+}
+
+bool huffman::decode(std::istream &in, std::ostream &out,
+                     const std::vector<std::pair<char, ull>> &codes, ull len_stream) {
+    decode_table table(codes);
+    if (!table.valid()) {
+        return decode_bits(in, out, codes, len_stream);
+    }
 
     unsigned char buffer[buff_size];
     unsigned char out_buffer[buff_size];
 
-    auto buff_ind = 0;
-    auto write = [&](auto x) {
-        if (buff_ind + sizeof(x) >= buff_size) {
+    uint buff_ind = 0;
+    auto write = [&](unsigned char x) {
+        if (buff_ind == buff_size) {
             out.write((char *) out_buffer, buff_ind);
             buff_ind = 0;
         }
-        memcpy(out_buffer + buff_ind, &x, sizeof(x));
-        buff_ind += sizeof(x);
+        out_buffer[buff_ind++] = x;
     };
 
-    uint cur_size;
-    while ((cur_size = in.readsome((char *) buffer, buff_size)) > 0) {
-        for (size_t j = 0; j < cur_size; j++) {
-            for (uint bit = 0; bit < std::min<ull>(8, len_stream); bit++) {
-                if (code_trie.step((buffer[j] >> bit) & 1u)) {
-                    if (code_trie.end()) {
-                        write(code_trie.get());
-                        code_trie.init();
-                    }
-                } else {
-                    return false;
-                }
+    // Bytes the reader has not loaded yet are moved to the front of the
+    // buffer before the next read, so the reader never runs dry mid-code
+    bit_reader reader(buffer, buffer);
+    bool eof = false;
+    while (len_stream > 0) {
+        if (reader.bytes_left() < sizeof(ull) && !eof) {
+            size_t left = reader.bytes_left();
+            memmove(buffer, reader.position(), left);
+            in.read((char *) buffer + left, buff_size - left);
+            uint cur_size = in.gcount();
+            eof = (cur_size == 0);
+            reader.set_input(buffer, buffer + left + cur_size);
+            continue;
+        }
+        reader.refill();
+        while (len_stream > 0 && reader.available() >= table.max_length()) {
+            uint symbol;
+            uint length = table.decode(reader.peek(), symbol);
+            if (length == 0 || length > len_stream) {
+                return false;
+            }
+            reader.consume(length);
+            len_stream -= length;
+            write((unsigned char) symbol);
+        }
+        if (eof && len_stream > 0 && reader.available() < table.max_length()) {
+            uint symbol;
+            uint length = table.decode(reader.peek(), symbol);
+            if (length == 0 || length > len_stream || length > reader.available()) {
+                return false;
             }
-            len_stream = (len_stream >= 8 ? len_stream - 8 : 0);
+            reader.consume(length);
+            len_stream -= length;
+            write((unsigned char) symbol);
         }
     }
     if (buff_ind) {
@@ -166,10 +1468,34 @@ std::vector<std::pair<char, ull>> huffman::code(const std::vector<ull> &cnt) {
     return res;
 }
 
+std::vector<unsigned char> huffman::code_lengths(const std::vector<ull> &cnt, uint max_len) {
+    std::vector<unsigned char> res(cnt.size());
+    package_merge(cnt.data(), cnt.size(), max_len, res.data());
+    return res;
+}
+
+ull huffman::encoded_bits(const std::vector<ull> &cnt, const std::vector<unsigned char> &lengths) {
+    ull res = 0;
+    for (uint i = 0; i < cnt.size(); i++) {
+        res += cnt[i] * lengths[i];
+    }
+    return res;
+}
+
+std::vector<std::pair<char, ull>> huffman::canonical(const std::vector<unsigned char> &lengths) {
+    std::vector<std::pair<char, ull>> res(lengths.size());
+    canonical_codes(lengths.data(), lengths.size(), res.data());
+    return res;
+}
+
+bool huffman::valid_lengths(const std::vector<unsigned char> &lengths) {
+    return kraft_fits(lengths.data(), lengths.size());
+}
+
 ull huffman::rev(ull num, char bits) {
     ull res = 0;
     for (uint i = 0; i < bits; i++) {
-        uint bit = (num >> i) & 1u;
+        ull bit = (num >> i) & 1u;
         res |= (bit << (bits - i - 1));
     }
     return res;
@@ -1,6 +1,9 @@
 #ifndef HUFFMAN_HUFFMAN_H
 #define HUFFMAN_HUFFMAN_H
 
+#include <cstdint>
+#include <iosfwd>
+
 typedef uint32_t uint;
 typedef uint64_t ull;
 
@@ -10,17 +13,82 @@ class huffman {
 public:
     huffman() = default;
 
-    static bool decompress(std::istream &out, std::ostream &in);
+    // threads = 0 uses every hardware thread; blocks are processed in
+    // parallel and written in order. buffers > 0 reads on a separate thread
+    // so reading, decoding and writing overlap, with at most that many
+    // blocks held in memory; 0 reads and writes on the calling thread.
+    static bool decompress(std::istream &out, std::ostream &in, uint threads = 1, uint buffers = 0);
+
+    // streams = 4 or 8 splits each block into that many interleaved
+    // bitstreams for faster decoding, 1 writes a single stream. contexts
+    // lets blocks pick their code table by the class of the previous byte
+    // where that compresses better; such blocks decode as one stream.
+    // level 1 to 9 runs an LZ77 match search first, deeper at higher levels,
+    // and codes blocks as literals and matches where that is smaller; 0
+    // only entropy-codes. buffers works as for decompress.
+    static void compress(std::istream &in, std::ostream &out, uint threads = 1, uint streams = 4,
+                         bool contexts = false, uint level = 0, uint buffers = 0);
+
+    // Largest compressed size of size input bytes
+    static size_t compress_bound(size_t size);
+
+    // Compresses a buffer into out, which must hold compress_bound(size)
+    // bytes, and returns the compressed size. With one thread and level 0
+    // this does not touch the heap.
+    static size_t compress(const unsigned char *in, size_t size, unsigned char *out,
+                           uint threads = 1, uint streams = 4, bool contexts = false, uint level = 0);
+
+    static void compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out,
+                         uint threads = 1, uint streams = 4, bool contexts = false, uint level = 0);
+
+    // Decompressed size of a block-format buffer; false if it is not one
+    static bool decompressed_size(const unsigned char *in, size_t size, ull &res);
+
+    // out_size must be the decompressed size. With one thread this does not
+    // touch the heap, except for the code tables of context blocks.
+    static bool decompress(const unsigned char *in, size_t size, unsigned char *out, size_t out_size,
+                           uint threads = 1);
+
+    static bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out,
+                           uint threads = 1);
 
-    static void compress(std::istream &in, std::ostream &out);
+    // Writes the decompressed bytes [offset, offset + length) of a seekable
+    // block-format stream; a range past the end is cut short
+    static bool decompress_range(std::istream &in, ull offset, ull length, std::ostream &out);
 
     static std::vector<std::pair<char, ull>> code(const std::vector<ull> &cnt);
 
+    // Optimal code lengths of at most max_len bits for the symbols with nonzero
+    // counts; max_len is raised if 2^max_len symbols cannot hold them all.
+    // Any alphabet size works; past 288 symbols the scratch is heap-allocated.
+    static std::vector<unsigned char> code_lengths(const std::vector<ull> &cnt, uint max_len = max_code_len);
+
+    // Size of the encoded stream in bits
+    static ull encoded_bits(const std::vector<ull> &cnt, const std::vector<unsigned char> &lengths);
+
+    // Canonical codes for the given lengths; symbols of length 0 get no code
+    static std::vector<std::pair<char, ull>> canonical(const std::vector<unsigned char> &lengths);
+
+    static bool valid_lengths(const std::vector<unsigned char> &lengths);
+
     static const uint buff_size;
     static const uint len;
+    static const uint max_code_len;
+    static const uint block_size;
+    static const uint max_block_size;
 
 
     static ull rev(ull num, char bits);
+
+private:
+    static const char magic[4];
+
+    static bool decompress_single(std::istream &in, std::ostream &out);
+
+    static bool decompress_legacy(const char *head, size_t head_size, std::istream &in, std::ostream &out);
+
+    static bool decode(std::istream &in, std::ostream &out,
+                       const std::vector<std::pair<char, ull>> &codes, ull len_stream);
 };
 
 
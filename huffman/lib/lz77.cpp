@@ -0,0 +1,117 @@
+#include "lz77.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint hash_bits = 15;
+
+    uint hash(const unsigned char *p) {
+        uint word;
+        memcpy(&word, p, sizeof(word));
+        return (word * 2654435761u) >> (32 - hash_bits);
+    }
+
+    uint match_length(const unsigned char *a, const unsigned char *b, uint limit) {
+        uint len = 0;
+        while (len + sizeof(ull) <= limit) {
+            ull x, y;
+            memcpy(&x, a + len, sizeof(x));
+            memcpy(&y, b + len, sizeof(y));
+            if (x != y) {
+                return len + (__builtin_ctzll(x ^ y) >> 3);
+            }
+            len += sizeof(ull);
+        }
+        while (len < limit && a[len] == b[len]) {
+            len++;
+        }
+        return len;
+    }
+
+    class matcher {
+    public:
+        matcher(const unsigned char *data, size_t size, const lz77::params &p)
+                : data(data), size(size), p(p), head(1u << hash_bits, -1), prev(size) {}
+
+        // Longest match for position i against earlier positions, 0 if none
+        // reaches min_match
+        uint find(size_t i, uint &distance) {
+            for (; inserted < i; inserted++) {
+                if (inserted + lz77::min_match <= size) {
+                    uint h = hash(data + inserted);
+                    prev[inserted] = head[h];
+                    head[h] = (int) inserted;
+                }
+            }
+            if (i + lz77::min_match > size) {
+                return 0;
+            }
+            uint limit = (uint) std::min<size_t>(lz77::max_match, size - i);
+            uint best = lz77::min_match - 1;
+            uint depth = p.depth;
+            for (int cand = head[hash(data + i)]; cand >= 0 && i - cand <= p.window && depth > 0;
+                 cand = prev[cand], depth--) {
+                if (data[cand + best] != data[i + best]) {
+                    continue;
+                }
+                uint len = match_length(data + cand, data + i, limit);
+                if (len > best) {
+                    best = len;
+                    distance = (uint) (i - cand);
+                    if (len >= p.nice || len == limit) {
+                        break;
+                    }
+                }
+            }
+            return best >= lz77::min_match ? best : 0;
+        }
+
+    private:
+        const unsigned char *data;
+        size_t size;
+        lz77::params p;
+        std::vector<int> head, prev;
+        size_t inserted = 0;
+    };
+}
+
+lz77::params lz77::level(uint level) {
+    static const params levels[] = {
+            {1u << 15, 4, 16, false},
+            {1u << 15, 8, 32, false},
+            {1u << 15, 16, 64, false},
+            {1u << 16, 16, 64, true},
+            {1u << 16, 32, 128, true},
+            {1u << 16, 64, 128, true},
+            {1u << 17, 128, 258, true},
+            {1u << 17, 512, 258, true},
+            {1u << 17, 4096, 258, true},
+    };
+    return levels[std::min(std::max(level, 1u), 9u) - 1];
+}
+
+void lz77::parse(const unsigned char *data, size_t size, const params &p, std::vector<uint> &tokens) {
+    matcher m(data, size, p);
+    size_t i = 0;
+    while (i < size) {
+        uint distance = 0;
+        uint len = m.find(i, distance);
+        if (len == 0) {
+            tokens.push_back(data[i++]);
+            continue;
+        }
+        while (p.lazy && len < p.nice && i + 1 < size) {
+            uint next_distance = 0;
+            uint next = m.find(i + 1, next_distance);
+            if (next <= len) {
+                break;
+            }
+            tokens.push_back(data[i++]);
+            len = next;
+            distance = next_distance;
+        }
+        tokens.push_back(match_flag | (len - min_match) << window_bits | (distance - 1));
+        i += len;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef HUFFMAN_LZ77_H
+#define HUFFMAN_LZ77_H
+
+#include <cstddef>
+#include <cstdint>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+#include <vector>
+
+// Hash-chain LZ77 match finder. A parse is a list of tokens: a literal byte
+// value below 256, or match_flag | (length - min_match) << window_bits |
+// (distance - 1).
+namespace lz77 {
+    const uint min_match = 4;
+    const uint max_match = 258;
+    const uint window_bits = 17;
+    const uint max_window = 1u << window_bits;
+    const uint match_flag = 1u << 31;
+
+    // Lengths and distances are coded deflate-style: values below 4 are
+    // their own code, larger ones share a code per half power of two and
+    // carry the rest in extra bits
+    const uint length_codes = 16;
+    const uint distance_codes = 2 * window_bits;
+
+    inline uint bucket(uint value, uint &extra_bits, uint &extra) {
+        if (value < 4) {
+            extra_bits = extra = 0;
+            return value;
+        }
+        uint top = 31 - __builtin_clz(value);
+        extra_bits = top - 1;
+        extra = value & ((1u << extra_bits) - 1);
+        return 2 * top + ((value >> extra_bits) & 1u);
+    }
+
+    inline uint bucket_base(uint code, uint &extra_bits) {
+        if (code < 4) {
+            extra_bits = 0;
+            return code;
+        }
+        extra_bits = code / 2 - 1;
+        return (2u | (code & 1u)) << extra_bits;
+    }
+
+    // Search effort: how far back matches may start, how many candidates a
+    // position tries, the length that ends the search early, and whether a
+    // match waits a byte when the next position has a longer one
+    struct params {
+        uint window;
+        uint depth;
+        uint nice;
+        bool lazy;
+    };
+
+    // Levels 1 (fastest) to 9 (smallest output)
+    params level(uint level);
+
+    // Appends the tokens of data to tokens; matches stay inside data
+    void parse(const unsigned char *data, size_t size, const params &p, std::vector<uint> &tokens);
+}
+
+#endif //HUFFMAN_LZ77_H
@@ -0,0 +1,229 @@
+#include "tans.h"
+#include "bit_reader.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const uint alphabet = 256;
+    const uint states = 4;
+
+    uint high_bit(uint x) {
+        return 31 - __builtin_clz(x);
+    }
+
+    // Spreads the symbols over the table with a step coprime to its size,
+    // so each one's states are scattered rather than bunched
+    void spread(const uint16_t *norm, unsigned char *symbols) {
+        const uint step = (tans::table_size >> 1) + (tans::table_size >> 3) + 3;
+        uint pos = 0;
+        for (uint s = 0; s < alphabet; s++) {
+            for (uint i = 0; i < norm[s]; i++) {
+                symbols[pos] = (unsigned char) s;
+                pos = (pos + step) & (tans::table_size - 1);
+            }
+        }
+    }
+
+    // Fills an LSB-first stream from the top down: bits put later end up
+    // lower, where a forward reader meets them first
+    class backward_writer {
+    public:
+        backward_writer(unsigned char *begin, unsigned char *end) : begin(begin), end(end), ptr(end) {}
+
+        // Bits go right below those already held, filling the accumulator
+        // from the top; at most 56 between flushes
+        void put(ull bits, uint count) {
+            used += count;
+            acc |= (bits << 1) << (63 - used);
+        }
+
+        void flush() {
+            if (ptr - begin < (ptrdiff_t) sizeof(acc)) {
+                overflow = true;
+                return;
+            }
+            memcpy(ptr - sizeof(acc), &acc, sizeof(acc));
+            uint bytes = used >> 3;
+            ptr -= bytes;
+            acc <<= bytes * 8;
+            used &= 7;
+        }
+
+        // Ends with the marker bit; returns the stream size, or 0 on overflow
+        size_t finish() {
+            put(1, 1);
+            flush();
+            if (used) {
+                if (ptr == begin) {
+                    return 0;
+                }
+                *--ptr = (unsigned char) (acc >> 56);
+            }
+            return overflow ? 0 : end - ptr;
+        }
+
+    private:
+        unsigned char *begin, *end, *ptr;
+        ull acc = 0;
+        uint used = 0;
+        bool overflow = false;
+    };
+}
+
+bool tans::normalize(const ull *cnt, uint16_t *norm) {
+    ull total = 0;
+    for (uint s = 0; s < alphabet; s++) {
+        total += cnt[s];
+    }
+    if (total == 0) {
+        return false;
+    }
+    uint sum = 0, largest = 0;
+    for (uint s = 0; s < alphabet; s++) {
+        norm[s] = 0;
+        if (cnt[s]) {
+            double scaled = (double) cnt[s] * table_size / total;
+            norm[s] = (uint16_t) (scaled < 1 ? 1 : (uint) (scaled + 0.5));
+            sum += norm[s];
+            if (cnt[s] > cnt[largest]) {
+                largest = s;
+            }
+        }
+    }
+    // Rounding errors go to the most frequent symbol, where they cost least
+    int fixed = (int) norm[largest] + (int) table_size - (int) sum;
+    if (fixed < 1) {
+        return false;
+    }
+    norm[largest] = (uint16_t) fixed;
+    return true;
+}
+
+double tans::cost_bits(const ull *cnt, const uint16_t *norm) {
+    double bits = 0;
+    for (uint s = 0; s < alphabet; s++) {
+        if (cnt[s]) {
+            bits += cnt[s] * (table_log - std::log2((double) norm[s]));
+        }
+    }
+    return bits;
+}
+
+size_t tans::encode(const unsigned char *data, size_t size, const uint16_t *norm,
+                    unsigned char *begin, unsigned char *end) {
+    unsigned char symbols[table_size];
+    spread(norm, symbols);
+
+    // Encoder states run over [table_size, 2 * table_size). A symbol with
+    // norm n moves state x to the next state of the (x >> bits)-th slot
+    // among its n, writing the low bits that shift drops.
+    uint cumul[alphabet + 1];
+    cumul[0] = 0;
+    for (uint s = 0; s < alphabet; s++) {
+        cumul[s + 1] = cumul[s] + norm[s];
+    }
+    uint16_t next_state[table_size];
+    uint slot[alphabet];
+    memcpy(slot, cumul, sizeof(slot));
+    for (uint u = 0; u < table_size; u++) {
+        next_state[slot[symbols[u]]++] = (uint16_t) (table_size + u);
+    }
+    struct transform {
+        uint delta_bits;
+        int delta_state;
+    } tt[alphabet];
+    for (uint s = 0; s < alphabet; s++) {
+        if (norm[s]) {
+            uint max_bits = (norm[s] == 1 ? table_log : table_log - high_bit(norm[s] - 1u));
+            tt[s].delta_bits = (max_bits << 16) - ((uint) norm[s] << max_bits);
+            tt[s].delta_state = (int) cumul[s] - (int) norm[s];
+        }
+    }
+
+    backward_writer writer(begin, end);
+    uint state[states] = {table_size, table_size, table_size, table_size};
+    for (size_t i = size; i-- > 0;) {
+        const transform &t = tt[data[i]];
+        uint &x = state[i % states];
+        uint bits = (x + t.delta_bits) >> 16;
+        writer.put(x & ((1u << bits) - 1), bits);
+        x = next_state[(x >> bits) + t.delta_state];
+        if ((i & 3) == 0) {
+            writer.flush();
+        }
+    }
+    writer.flush();
+    for (uint k = states; k-- > 0;) {
+        writer.put(state[k] - table_size, table_log);
+    }
+    return writer.finish();
+}
+
+bool tans::decoder::build(const uint16_t *norm) {
+    uint sum = 0;
+    for (uint s = 0; s < alphabet; s++) {
+        sum += norm[s];
+    }
+    if (sum != table_size) {
+        return false;
+    }
+    unsigned char symbols[table_size];
+    spread(norm, symbols);
+    uint next[alphabet];
+    for (uint s = 0; s < alphabet; s++) {
+        next[s] = norm[s];
+    }
+    for (uint u = 0; u < table_size; u++) {
+        unsigned char s = symbols[u];
+        uint x = next[s]++;
+        uint bits = table_log - high_bit(x);
+        table[u].symbol = s;
+        table[u].bits = (uint8_t) bits;
+        table[u].base = (uint16_t) ((x << bits) - table_size);
+    }
+    return true;
+}
+
+bool tans::decoder::decode(const unsigned char *in, size_t size, unsigned char *out, size_t count) const {
+    if (size == 0 || in[0] == 0) {
+        return false;
+    }
+    bit_reader reader(in, in + size);
+    reader.refill();
+    uint skip = __builtin_ctz(in[0]) + 1;
+    if (reader.available() < skip + states * table_log) {
+        return false;
+    }
+    reader.consume(skip);
+    uint state[states];
+    for (uint &x : state) {
+        x = (uint) reader.peek() & (table_size - 1);
+        reader.consume(table_log);
+    }
+
+    // One symbol per state takes at most 44 bits, so one refill covers a
+    // round while 8 bytes of input remain
+    size_t i = 0;
+    while (i + states <= count && reader.bytes_left() >= sizeof(ull)) {
+        reader.refill();
+        for (uint k = 0; k < states; k++) {
+            entry e = table[state[k]];
+            out[i + k] = e.symbol;
+            state[k] = e.base + ((uint) reader.peek() & ((1u << e.bits) - 1));
+            reader.consume(e.bits);
+        }
+        i += states;
+    }
+    for (; i < count; i++) {
+        reader.refill();
+        entry e = table[state[i % states]];
+        if (e.bits > reader.available()) {
+            return false;
+        }
+        out[i] = e.symbol;
+        state[i % states] = e.base + ((uint) reader.peek() & ((1u << e.bits) - 1));
+        reader.consume(e.bits);
+    }
+    return (state[0] | state[1] | state[2] | state[3]) == 0;
+}
@@ -0,0 +1,55 @@
+#ifndef HUFFMAN_TANS_H
+#define HUFFMAN_TANS_H
+
+#include <cstddef>
+#include <cstdint>
+typedef uint32_t uint;
+typedef uint64_t ull;
+
+// Table-based asymmetric numeral system (tANS, as in FSE) over bytes.
+// Symbol frequencies are normalized to sum to table_size. Four states take
+// turns over the symbols so consecutive lookups do not depend on each
+// other.
+//
+// The encoder runs over the data backwards and writes its bitstream from
+// the end of the output buffer down, so the decoder reads it forwards like
+// every other stream. The first byte starts with zero padding and a marker
+// bit, then come the four final states and the bits of each symbol in order.
+namespace tans {
+    // 2^11 decoder entries of 4 bytes stay in L1, and a symbol reads at most
+    // 11 bits, so one refill covers a symbol per state
+    const uint table_log = 11;
+    const uint table_size = 1u << table_log;
+
+    // Scales cnt[256] to norm[256] summing to table_size, keeping every
+    // present symbol at 1 or more; false if that is not possible
+    bool normalize(const ull *cnt, uint16_t *norm);
+
+    // Bits the symbols of cnt take with norm, near enough to pick a coding
+    double cost_bits(const ull *cnt, const uint16_t *norm);
+
+    // Writes the stream to the end of [begin, end) and returns its size, or
+    // 0 if it does not fit
+    size_t encode(const unsigned char *data, size_t size, const uint16_t *norm,
+                  unsigned char *begin, unsigned char *end);
+
+    class decoder {
+    public:
+        // False unless norm sums to table_size
+        bool build(const uint16_t *norm);
+
+        // Decodes count symbols; false if the stream is short or corrupt
+        bool decode(const unsigned char *in, size_t size, unsigned char *out, size_t count) const;
+
+    private:
+        struct entry {
+            uint16_t base;
+            uint8_t symbol;
+            uint8_t bits;
+        };
+
+        entry table[table_size];
+    };
+}
+
+#endif //HUFFMAN_TANS_H
@@ -1,8 +1,52 @@
 #include <iostream>
 #include <random>
+#include <algorithm>
+#include <atomic>
 #include "huffman.h"
+#include "bit_reader.h"
+#include "bit_writer.h"
+#include "block_pipeline.h"
+#include "histogram.h"
 #include "gtest/gtest.h"
 
+// Every allocation path goes through the counter. Atomic: the pipeline
+// workers allocate too
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// Kept out of line: with free() inlined into the deletes GCC pairs it with
+// operator new and warns about a mismatch
+__attribute__((noinline)) static void release(void *p) {
+    std::free(p);
+}
+
+void operator delete(void *p) noexcept {
+    release(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    release(p);
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept {
+    release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    release(p);
+}
+
 TEST(correctness, empty) {
     std::stringstream in(""), code, out;
 
@@ -98,4 +142,675 @@ TEST(correctness, compress_compressed) {
     huffman::decompress(code2, out2);
     huffman::decompress(out2, out);
     EXPECT_EQ(in.str(), out.str());
-}
\ No newline at end of file
+}
+
+static std::string fibonacci_text(int symbols) {
+    std::string res;
+    ull a = 1, b = 1;
+    for (int i = 0; i < symbols; i++) {
+        res.append(a, (char) ('A' + i));
+        ull c = a + b;
+        a = b;
+        b = c;
+    }
+    std::shuffle(res.begin(), res.end(), std::mt19937(1));
+    return res;
+}
+
+TEST(correctness, long_codes) {
+    std::stringstream in(fibonacci_text(18)), code, out;
+
+    huffman::compress(in, code);
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(in.str(), out.str());
+}
+
+TEST(correctness, very_long_codes) {
+    std::stringstream in(fibonacci_text(27)), code, out;
+
+    huffman::compress(in, code);
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(in.str(), out.str());
+}
+
+// Index after the end marker of a one-block stream: one entry, the count and the tag
+static const size_t single_block_index = 2 * sizeof(ull) + sizeof(ull) + 4;
+
+TEST(correctness, truncated_stream) {
+    std::stringstream in(fibonacci_text(12)), code, out;
+
+    huffman::compress(in, code);
+    std::string data = code.str();
+    std::stringstream cut(data.substr(0, data.size() - single_block_index - 8));
+    EXPECT_FALSE(huffman::decompress(cut, out));
+}
+
+TEST(correctness, small_header) {
+    std::stringstream in("abracadabra"), code, out;
+
+    huffman::compress(in, code);
+    EXPECT_LT(code.str().size(), 192u);
+    huffman::decompress(code, out);
+    EXPECT_EQ(in.str(), out.str());
+}
+
+TEST(correctness, limited_lengths) {
+    std::string text = fibonacci_text(27);
+    std::vector<ull> cnt(huffman::len);
+    for (char c : text) {
+        cnt[(unsigned char) c]++;
+    }
+    auto lengths = huffman::code_lengths(cnt);
+    EXPECT_TRUE(huffman::valid_lengths(lengths));
+    for (uint i = 0; i < huffman::len; i++) {
+        EXPECT_EQ(cnt[i] == 0, lengths[i] == 0);
+        EXPECT_LE(lengths[i], huffman::max_code_len);
+    }
+}
+
+TEST(correctness, canonical_codes) {
+    std::vector<unsigned char> lengths(huffman::len);
+    lengths['a'] = 1;
+    lengths['b'] = 2;
+    lengths['c'] = 3;
+    lengths['d'] = 3;
+    auto codes = huffman::canonical(lengths);
+    EXPECT_EQ(codes['a'], std::make_pair((char) 1, (ull) 0));
+    EXPECT_EQ(codes['b'], std::make_pair((char) 2, (ull) 2));
+    EXPECT_EQ(codes['c'], std::make_pair((char) 3, (ull) 6));
+    EXPECT_EQ(codes['d'], std::make_pair((char) 3, (ull) 7));
+    EXPECT_EQ(codes['e'].first, 0);
+}
+
+// Writes text in the format used before canonical codes
+static std::string legacy_stream(const std::string &text) {
+    std::vector<ull> cnt(huffman::len);
+    for (char c : text) {
+        cnt[(unsigned char) c]++;
+    }
+    auto codes = huffman::code(cnt);
+
+    std::string bits;
+    for (char c : text) {
+        auto cur = codes[(unsigned char) c];
+        for (int i = cur.first - 1; i >= 0; i--) {
+            bits += (char) ((cur.second >> i) & 1u);
+        }
+    }
+    std::stringstream code;
+    ull len_stream = bits.size();
+    code.write((char *) &len_stream, sizeof(len_stream));
+    for (uint i = 0; i < huffman::len; i++) {
+        unsigned char num = i;
+        code.write((char *) &num, sizeof(num));
+        code.write((char *) &cnt[i], sizeof(cnt[i]));
+    }
+    for (size_t i = 0; i < bits.size(); i += 8) {
+        unsigned char byte = 0;
+        for (size_t j = i; j < i + 8 && j < bits.size(); j++) {
+            byte |= bits[j] << (j - i);
+        }
+        code.write((char *) &byte, sizeof(byte));
+    }
+    return code.str();
+}
+
+TEST(correctness, legacy_format) {
+    std::string text = "legacy streams carry the full histogram";
+    std::stringstream code(legacy_stream(text)), out;
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(text, out.str());
+}
+
+TEST(correctness, legacy_long_codes) {
+    // Codes too long for the lookup table go through the trie
+    std::string text = fibonacci_text(27);
+    std::string data = legacy_stream(text);
+    std::stringstream code(data), out;
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(text, out.str());
+
+    std::stringstream cut(data.substr(0, data.size() - 1)), cut_out;
+    EXPECT_FALSE(huffman::decompress(cut, cut_out));
+}
+
+TEST(correctness, package_merge_cost) {
+    std::string text = fibonacci_text(27);
+    std::vector<ull> cnt(huffman::len);
+    for (char c : text) {
+        cnt[(unsigned char) c]++;
+    }
+    std::vector<unsigned char> unlimited(huffman::len);
+    auto codes = huffman::code(cnt);
+    for (uint i = 0; i < huffman::len; i++) {
+        unlimited[i] = codes[i].first;
+    }
+    ull optimal = huffman::encoded_bits(cnt, huffman::code_lengths(cnt, 63));
+    EXPECT_LE(optimal, huffman::encoded_bits(cnt, unlimited));
+
+    ull prev = optimal;
+    for (uint max_len = 15; max_len >= 5; max_len--) {
+        auto lengths = huffman::code_lengths(cnt, max_len);
+        ull bits = huffman::encoded_bits(cnt, lengths);
+        EXPECT_GE(bits, prev);
+        EXPECT_EQ(*std::max_element(lengths.begin(), lengths.end()), max_len);
+        prev = bits;
+    }
+}
+
+TEST(correctness, package_merge_too_short) {
+    std::vector<ull> cnt(huffman::len, 1);
+    auto lengths = huffman::code_lengths(cnt, 4);
+    for (uint i = 0; i < huffman::len; i++) {
+        EXPECT_EQ(lengths[i], 8);
+    }
+}
+
+TEST(correctness, package_merge_large_alphabet) {
+    // 400 equal counts: 112 codes of 8 bits and 288 of 9 fill the code space
+    std::vector<ull> cnt(400, 1);
+    auto lengths = huffman::code_lengths(cnt);
+    EXPECT_EQ(112, std::count(lengths.begin(), lengths.end(), 8));
+    EXPECT_EQ(288, std::count(lengths.begin(), lengths.end(), 9));
+    EXPECT_TRUE(huffman::valid_lengths(lengths));
+
+    // Limits past 63 bits act as no limit
+    for (uint i = 0; i < cnt.size(); i++) {
+        cnt[i] = i % 40 ? 1 : 1000 + i;
+    }
+    EXPECT_EQ(huffman::code_lengths(cnt, 63), huffman::code_lengths(cnt, 100));
+    EXPECT_TRUE(huffman::valid_lengths(huffman::code_lengths(cnt, 100)));
+}
+
+// Reads from a string without supporting seeks, like a pipe
+class pipe_buf : public std::streambuf {
+public:
+    explicit pipe_buf(const std::string &data) : data(data) {}
+
+protected:
+    int_type underflow() override {
+        if (pos == data.size()) {
+            return traits_type::eof();
+        }
+        size_t n = std::min<size_t>(1000, data.size() - pos);
+        char *p = &data[pos];
+        setg(p, p, p + n);
+        pos += n;
+        return traits_type::to_int_type(*p);
+    }
+
+private:
+    std::string data;
+    size_t pos = 0;
+};
+
+TEST(correctness, multiple_blocks) {
+    std::stringstream in, code, out;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 3 * huffman::block_size + 12345; i++) {
+        in << (char) ('a' + rnd() % (i < huffman::block_size ? 4 : 26));
+    }
+    huffman::compress(in, code);
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(in.str(), out.str());
+}
+
+TEST(correctness, unseekable_streams) {
+    std::string text = fibonacci_text(20);
+    pipe_buf in_buf(text);
+    std::istream in(&in_buf);
+    std::stringstream code, out;
+
+    huffman::compress(in, code);
+    pipe_buf code_buf(code.str());
+    std::istream code_in(&code_buf);
+    EXPECT_TRUE(huffman::decompress(code_in, out));
+    EXPECT_EQ(text, out.str());
+}
+
+TEST(correctness, missing_end_block) {
+    std::stringstream in("abracadabra"), code, out;
+
+    huffman::compress(in, code);
+    std::string data = code.str();
+    std::stringstream cut(data.substr(0, data.size() - single_block_index - 1));
+    EXPECT_FALSE(huffman::decompress(cut, out));
+}
+
+TEST(correctness, threads) {
+    std::stringstream in, code, out;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 10 * huffman::block_size + 777; i++) {
+        in << (char) ('a' + rnd() % (i / huffman::block_size + 1));
+    }
+    huffman::compress(in, code, 4);
+    std::stringstream single;
+    in.clear();
+    in.seekg(0);
+    huffman::compress(in, single);
+    EXPECT_EQ(code.str(), single.str());
+
+    EXPECT_TRUE(huffman::decompress(code, out, 4));
+    EXPECT_EQ(in.str(), out.str());
+}
+
+TEST(correctness, threads_corrupt_block) {
+    std::stringstream in, code, out;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 6 * huffman::block_size; i++) {
+        in << (char) ('a' + rnd() % 3);
+    }
+    huffman::compress(in, code, 3);
+    std::string data = code.str();
+    // Code lengths of the first block: 'a', 'b' and 'c' get one bit each
+    data[4 + 1 + 8 + 'b' / 2] = 0x11;
+    std::stringstream corrupt(data);
+    EXPECT_FALSE(huffman::decompress(corrupt, out, 3));
+}
+
+TEST(correctness, buffered_streams) {
+    std::stringstream in, single;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 10 * huffman::block_size + 777; i++) {
+        in << (char) ('a' + rnd() % (i / huffman::block_size + 1));
+    }
+    huffman::compress(in, single);
+
+    for (uint threads : {1, 3}) {
+        for (uint buffers : {1, 2, 5}) {
+            std::stringstream code, out;
+            in.clear();
+            in.seekg(0);
+            huffman::compress(in, code, threads, 4, false, 0, buffers);
+            EXPECT_EQ(single.str(), code.str());
+            EXPECT_TRUE(huffman::decompress(code, out, threads, buffers));
+            EXPECT_EQ(in.str(), out.str());
+
+            // An unknown block type in the middle stops the reader early;
+            // the index gives the file offset of block 5
+            std::string data = code.str();
+            ull count, offset;
+            memcpy(&count, &data[data.size() - 4 - sizeof(count)], sizeof(count));
+            memcpy(&offset, &data[data.size() - 4 - sizeof(count) - (count - 5) * 16 + 8], sizeof(offset));
+            ASSERT_LT(offset, data.size());
+            data[offset] = 0x7f;
+            std::stringstream corrupt(data), partial;
+            EXPECT_FALSE(huffman::decompress(corrupt, partial, threads, buffers));
+        }
+    }
+}
+
+TEST(correctness, pipeline_exceptions) {
+    // Each stage throws in turn on the fifth block, from the reader, the
+    // workers or the calling thread
+    for (uint stage = 0; stage < 3; stage++) {
+        for (uint threads : {1, 3}) {
+            for (uint buffers : {0, 2}) {
+                block_pipeline<uint> pipeline(threads, buffers);
+                uint next = 0;
+                auto fail = [&](uint at, uint slot) {
+                    if (stage == at && slot == 5) {
+                        throw std::runtime_error("stage");
+                    }
+                };
+                EXPECT_THROW(pipeline.run([&](uint &slot) {
+                    slot = next++;
+                    fail(0, slot);
+                    return slot < 100;
+                }, [&](uint &slot) {
+                    fail(1, slot);
+                }, [&](uint &slot) {
+                    fail(2, slot);
+                    return true;
+                }), std::runtime_error);
+            }
+        }
+    }
+}
+
+TEST(correctness, decompress_range) {
+    std::stringstream in, code;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 5 * huffman::block_size + 100; i++) {
+        in << (char) ('a' + rnd() % 26);
+    }
+    huffman::compress(in, code, 2);
+    std::string text = in.str();
+
+    std::vector<std::pair<ull, ull>> ranges = {{0, 10}, {huffman::block_size - 5, 10}, {12345, 3 * huffman::block_size},
+                                               {text.size() - 7, 100}, {text.size() + 5, 10}, {42, 0}};
+    for (auto const &range : ranges) {
+        std::stringstream out;
+        code.clear();
+        code.seekg(0);
+        EXPECT_TRUE(huffman::decompress_range(code, range.first, range.second, out));
+        EXPECT_EQ(range.first < text.size() ? text.substr(range.first, range.second) : "", out.str());
+    }
+}
+
+TEST(correctness, decompress_range_without_index) {
+    std::stringstream in("range access without a block index"), code, out;
+
+    huffman::compress(in, code);
+    std::string data = code.str();
+    std::stringstream cut(data.substr(0, data.size() - single_block_index));
+    EXPECT_TRUE(huffman::decompress_range(cut, 6, 6, out));
+    EXPECT_EQ("access", out.str());
+}
+
+TEST(correctness, interleaved_streams) {
+    for (uint streams : {1, 4, 8}) {
+        for (uint size : {0u, 5u, 1023u, 1024u, 1031u, 100000u}) {
+            std::stringstream in, code, out;
+            std::mt19937 rnd(size);
+            for (uint i = 0; i < size; i++) {
+                in << (char) ('a' + rnd() % 20);
+            }
+            huffman::compress(in, code, 1, streams);
+            EXPECT_TRUE(huffman::decompress(code, out));
+            EXPECT_EQ(in.str(), out.str());
+        }
+    }
+}
+
+TEST(correctness, interleaved_bad_jump_table) {
+    std::stringstream in, code, out;
+    for (uint i = 0; i < 5000; i++) {
+        in << (char) ('a' + i % 7);
+    }
+    huffman::compress(in, code, 1, 4);
+    std::string data = code.str();
+    // First stream size in the jump table that follows the block header
+    uint too_big = 1u << 20;
+    memcpy(&data[4 + 1 + 8 + huffman::len / 2 + 1], &too_big, sizeof(too_big));
+    std::stringstream corrupt(data);
+    EXPECT_FALSE(huffman::decompress(corrupt, out));
+}
+
+TEST(correctness, bit_writer_round_trip) {
+    std::mt19937 rnd(7);
+    std::vector<std::pair<ull, uint>> values;
+    for (int i = 0; i < 1000; i++) {
+        uint count = 1 + rnd() % 15;
+        values.push_back({rnd() & ((1u << count) - 1), count});
+    }
+    std::vector<unsigned char> buffer(1000 * 2 + 8);
+    bit_writer writer(buffer.data());
+    size_t bits = 0;
+    for (auto const &v : values) {
+        writer.put(v.first, v.second);
+        writer.flush();
+        bits += v.second;
+    }
+    EXPECT_EQ((bits + 7) / 8, writer.finish());
+
+    bit_reader reader(buffer.data(), buffer.data() + (bits + 7) / 8);
+    for (auto const &v : values) {
+        reader.refill();
+        EXPECT_EQ(v.first, reader.peek() & ((1u << v.second) - 1));
+        reader.consume(v.second);
+    }
+}
+
+TEST(correctness, buffer_entry_points) {
+    std::string text = fibonacci_text(22);
+    for (uint threads : {1, 3}) {
+        std::vector<unsigned char> code(huffman::compress_bound(text.size()));
+        size_t size = huffman::compress((const unsigned char *) text.data(), text.size(), code.data(), threads);
+        EXPECT_LE(size, code.size());
+
+        std::stringstream stream_in(text), stream_code;
+        huffman::compress(stream_in, stream_code);
+        EXPECT_EQ(stream_code.str(), std::string(code.begin(), code.begin() + size));
+
+        ull raw_size;
+        EXPECT_TRUE(huffman::decompressed_size(code.data(), size, raw_size));
+        EXPECT_EQ(text.size(), raw_size);
+        std::string out(raw_size, 0);
+        EXPECT_TRUE(huffman::decompress(code.data(), size, (unsigned char *) &out[0], out.size(), threads));
+        EXPECT_EQ(text, out);
+        EXPECT_FALSE(huffman::decompress(code.data(), size - single_block_index - 1, (unsigned char *) &out[0], out.size(), threads));
+    }
+}
+
+TEST(correctness, buffer_vectors) {
+    std::string text = fibonacci_text(16);
+    std::vector<unsigned char> code, out;
+    huffman::compress((const unsigned char *) text.data(), text.size(), code, 2);
+    EXPECT_TRUE(huffman::decompress(code.data(), code.size(), out, 2));
+    EXPECT_EQ(text, std::string(out.begin(), out.end()));
+
+    code[5] = 0xff;
+    EXPECT_FALSE(huffman::decompress(code.data(), code.size(), out));
+}
+
+TEST(correctness, small_buffers_do_not_allocate) {
+    unsigned char in[4000], code[8192], out[4000];
+    ASSERT_LE(huffman::compress_bound(sizeof(in)), sizeof(code));
+    std::mt19937 rnd(3);
+    for (auto &c : in) {
+        c = (unsigned char) ('a' + rnd() % 30);
+    }
+
+    size_t before = allocations;
+    size_t size = huffman::compress(in, sizeof(in), code);
+    ull raw_size = 0;
+    bool ok = huffman::decompressed_size(code, size, raw_size) &&
+              huffman::decompress(code, size, out, raw_size);
+    EXPECT_EQ(before, allocations);
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+}
+
+TEST(correctness, incompressible_blocks_are_stored) {
+    std::stringstream in, code, out, range;
+
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 2 * huffman::block_size + 999; i++) {
+        in << (char) (rnd() % 256);
+    }
+    huffman::compress(in, code);
+    EXPECT_LE(code.str().size(), huffman::compress_bound(in.str().size()));
+    EXPECT_LE(code.str().size(), in.str().size() + 100);
+    EXPECT_TRUE(huffman::decompress(code, out));
+    EXPECT_EQ(in.str(), out.str());
+
+    code.clear();
+    code.seekg(0);
+    EXPECT_TRUE(huffman::decompress_range(code, huffman::block_size - 10, 20, range));
+    EXPECT_EQ(in.str().substr(huffman::block_size - 10, 20), range.str());
+
+    std::string data = code.str();
+    std::vector<unsigned char> buffer;
+    EXPECT_TRUE(huffman::decompress((const unsigned char *) data.data(), data.size(), buffer));
+    EXPECT_EQ(in.str(), std::string(buffer.begin(), buffer.end()));
+
+    data[5] ^= 1;
+    std::stringstream corrupt(data), corrupt_out;
+    EXPECT_FALSE(huffman::decompress(corrupt, corrupt_out));
+}
+
+TEST(correctness, repeated_byte_blocks) {
+    std::string text(3 * huffman::block_size, 'a');
+    text += std::string(1000, 'b') + "ab";
+    std::stringstream in(text), code, out;
+
+    huffman::compress(in, code, 2);
+    EXPECT_LT(code.str().size(), 400u);
+    EXPECT_TRUE(huffman::decompress(code, out, 2));
+    EXPECT_EQ(text, out.str());
+
+    std::string data = code.str();
+    std::vector<unsigned char> buffer;
+    EXPECT_TRUE(huffman::decompress((const unsigned char *) data.data(), data.size(), buffer));
+    EXPECT_EQ(text, std::string(buffer.begin(), buffer.end()));
+}
+
+TEST(correctness, tiny_stored_block_buffer) {
+    // The buffer holds nothing past the index, so a stored block must not
+    // be read as if it carried code lengths
+    unsigned char in[] = {'x'};
+    std::vector<unsigned char> code, out;
+    huffman::compress(in, sizeof(in), code);
+    code.shrink_to_fit();
+    std::vector<unsigned char> exact(code);
+    EXPECT_TRUE(huffman::decompress(exact.data(), exact.size(), out));
+    EXPECT_EQ(std::vector<unsigned char>(in, in + 1), out);
+}
+
+TEST(correctness, histogram) {
+    std::mt19937 rnd(5);
+    std::vector<unsigned char> data(3 * 1024 * 1024 + 13);
+    for (auto &c : data) {
+        c = (unsigned char) (rnd() % 3 ? 'a' : rnd());
+    }
+    for (size_t size : {(size_t) 0, (size_t) 7, (size_t) 1001, data.size()}) {
+        ull expected[256] = {}, tables[256] = {}, threads[256] = {};
+        for (size_t i = 0; i < size; i++) {
+            expected[data[i]]++;
+        }
+        histogram::count(data.data(), size, tables);
+        histogram::count(data.data(), size, threads, 3);
+        EXPECT_TRUE(std::equal(expected, expected + 256, tables));
+        EXPECT_TRUE(std::equal(expected, expected + 256, threads));
+    }
+}
+
+static std::string json_text(size_t records) {
+    static const char *const names[] = {"alpha", "beta", "gamma", "delta"};
+    std::mt19937 rnd(7);
+    std::string res = "[";
+    for (size_t i = 0; i < records; i++) {
+        res += "{\"id\": " + std::to_string(rnd() % 100000) + ", \"name\": \"" + names[rnd() % 4] +
+               "\", \"tags\": [\"x" + std::to_string(rnd() % 10) + "\"], \"ok\": " +
+               (rnd() % 2 ? "true" : "false") + "},\n";
+    }
+    return res + "]";
+}
+
+TEST(correctness, context_blocks) {
+    std::string text = json_text(20000);
+    std::stringstream in(text), plain, code, out;
+
+    huffman::compress(in, plain);
+    in.clear();
+    in.seekg(0);
+    huffman::compress(in, code, 2, 4, true);
+    EXPECT_LT(code.str().size(), plain.str().size() * 9 / 10);
+    EXPECT_TRUE(huffman::decompress(code, out, 2));
+    EXPECT_EQ(text, out.str());
+
+    std::vector<unsigned char> buffer, res;
+    huffman::compress((const unsigned char *) text.data(), text.size(), buffer, 1, 4, true);
+    EXPECT_EQ(code.str(), std::string(buffer.begin(), buffer.end()));
+    EXPECT_TRUE(huffman::decompress(buffer.data(), buffer.size(), res));
+    EXPECT_EQ(text, std::string(res.begin(), res.end()));
+
+    // Dropping a class from the mask leaves its bytes without a table
+    ASSERT_EQ(5, buffer[4]);
+    ASSERT_TRUE(buffer[4 + 9] & 0x08);
+    buffer[4 + 9] &= ~0x08;
+    EXPECT_FALSE(huffman::decompress(buffer.data(), buffer.size(), res));
+}
+
+TEST(correctness, context_blocks_beat_stored) {
+    // High and low bytes alternate, so every byte value is equally common
+    // and no order-0 code saves anything, but the class of each byte
+    // narrows down the next one
+    std::string text;
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 100000; i++) {
+        text += (char) (0x80 + rnd() % 0x80);
+        text += (char) (rnd() % 0x80);
+    }
+    std::vector<unsigned char> code, out;
+    huffman::compress((const unsigned char *) text.data(), text.size(), code);
+    EXPECT_EQ(3, code[4]);
+    huffman::compress((const unsigned char *) text.data(), text.size(), code, 1, 4, true);
+    EXPECT_EQ(5, code[4]);
+    EXPECT_TRUE(huffman::decompress(code.data(), code.size(), out));
+    EXPECT_EQ(text, std::string(out.begin(), out.end()));
+}
+
+TEST(correctness, lz_levels) {
+    std::string text = json_text(5000);
+    std::mt19937 rnd(11);
+    std::string noise(5000, 0);
+    for (auto &c : noise) {
+        c = (char) rnd();
+    }
+    for (int i = 0; i < 40; i++) {
+        text += noise;
+    }
+    std::stringstream in(text), plain;
+    huffman::compress(in, plain);
+
+    size_t previous = plain.str().size();
+    for (uint level = 1; level <= 9; level += 4) {
+        std::stringstream code, out;
+        in.clear();
+        in.seekg(0);
+        huffman::compress(in, code, 2, 4, false, level);
+        EXPECT_LT(code.str().size(), previous);
+        EXPECT_TRUE(huffman::decompress(code, out, 2));
+        EXPECT_EQ(text, out.str());
+        previous = code.str().size();
+    }
+    EXPECT_LT(previous, plain.str().size() / 5);
+}
+
+TEST(correctness, lz_blocks) {
+    std::string text = fibonacci_text(14) + json_text(300) + fibonacci_text(14);
+    std::vector<unsigned char> code, out;
+    huffman::compress((const unsigned char *) text.data(), text.size(), code, 1, 4, true, 6);
+    ASSERT_EQ(6, code[4]);
+    EXPECT_TRUE(huffman::decompress(code.data(), code.size(), out));
+    EXPECT_EQ(text, std::string(out.begin(), out.end()));
+
+    std::stringstream in(text), range;
+    std::stringstream stream_code(std::string(code.begin(), code.end()));
+    EXPECT_TRUE(huffman::decompress_range(stream_code, 1000, 50, range));
+    EXPECT_EQ(text.substr(1000, 50), range.str());
+
+    // Garbage in place of the bitstream
+    for (size_t i = 4 + 9 + 153; i < code.size() - single_block_index - 1; i++) {
+        code[i] = 0xff;
+    }
+    EXPECT_FALSE(huffman::decompress(code.data(), code.size(), out));
+}
+
+TEST(correctness, tans_blocks) {
+    std::string text;
+    std::mt19937 rnd(1);
+    for (uint i = 0; i < 2 * huffman::block_size + 1000; i++) {
+        text += (char) (rnd() % 16 ? 'a' : 'b' + rnd() % 4);
+    }
+    std::vector<unsigned char> code, out;
+    huffman::compress((const unsigned char *) text.data(), text.size(), code);
+    ASSERT_EQ(7, code[4]);
+    EXPECT_TRUE(huffman::decompress(code.data(), code.size(), out));
+    EXPECT_EQ(text, std::string(out.begin(), out.end()));
+
+    std::stringstream in(text), stream_code, stream_out;
+    huffman::compress(in, stream_code, 3);
+    EXPECT_EQ(std::string(code.begin(), code.end()), stream_code.str());
+    EXPECT_TRUE(huffman::decompress(stream_code, stream_out, 3));
+    EXPECT_EQ(text, stream_out.str());
+
+    // Norms of the first block that no longer sum to the table size
+    std::vector<unsigned char> bad = code;
+    bad[4 + 9 + 32] ^= 0x40;
+    EXPECT_FALSE(huffman::decompress(bad.data(), bad.size(), out));
+
+    // Garbage in place of the first bitstream
+    bad = code;
+    for (size_t i = 4 + 9 + 32 + 10; i < 4 + 9 + 32 + 1000; i++) {
+        bad[i] = 0xff;
+    }
+    EXPECT_FALSE(huffman::decompress(bad.data(), bad.size(), out));
+}
@@ -1,46 +1,90 @@
 #include "trie.h"
 
+#include <algorithm>
+
+const uint trie::walk_bits;
+const uint16_t trie::leaf_flag;
+const uint trie::max_nodes;
 
 trie::trie(const std::vector<std::pair<char, ull>>& codes) {
-    for (uint i = 0; i < codes.size(); i++) {
-        insert(codes[i].first, codes[i].second, i);
+    // Every code opens at most one node per walk_bits bits past the root
+    size_t bound = 1;
+    for (auto const &c : codes) {
+        uint len = (unsigned char) c.first;
+        if (len > walk_bits) {
+            bound += (len - 1) / walk_bits;
+        }
+    }
+    slots.assign(std::min<size_t>(bound, max_nodes) * fanout, 0);
+
+    for (uint i = 0; i < codes.size() && ok; i++) {
+        uint len = (unsigned char) codes[i].first;
+        if (len > 0) {
+            ok = insert(len, codes[i].second, i);
+        }
     }
 }
 
-void trie::insert(unsigned char len, ull code, unsigned char symbol) {
-    node *vert = root;
-    for (uint i = 0; i < len; i++) {
-        uint cur = (code >> (len - i - 1u)) & 1u;
-        node *son = (cur ? vert->R : vert->L);
-        if (!son) {
-            verts.push_back(new node());
-            son = (cur ? vert->R : vert->L) = verts.back();
+bool trie::insert(uint len, ull code, unsigned char symbol) {
+    if (len > 64) {
+        return false;
+    }
+    uint node = 0;
+    for (uint depth = 0;; depth += walk_bits) {
+        uint take = std::min(len - depth, walk_bits);
+        uint bits = 0;
+        for (uint i = 0; i < take; i++) {
+            bits |= ((code >> (len - depth - i - 1u)) & 1u) << i;
+        }
+        uint16_t *slot = &slots[node * fanout];
+        if (depth + walk_bits >= len) {
+            for (uint high = 0; high < (1u << (walk_bits - take)); high++) {
+                uint16_t &e = slot[bits | high << take];
+                if (e) {
+                    return false;
+                }
+                e = leaf_flag | (take - 1) << used_shift | symbol;
+            }
+            return true;
+        }
+        uint16_t &e = slot[bits];
+        if (!e) {
+            if (nodes * fanout == slots.size()) {
+                return false;
+            }
+            e = nodes++;
+        } else if (e & leaf_flag) {
+            return false;
         }
-        vert = son;
+        node = e;
     }
-    vert->val = symbol;
 }
 
-bool trie::step(uint c) {
-    v = (c ? v->R : v->L);
-    return (v != nullptr);
+bool trie::valid() const {
+    return ok;
+}
+
+uint trie::step(uint bits) {
+    last = slots[v * fanout + (bits & (fanout - 1))];
+    if (!last) {
+        return 0;
+    }
+    if (last & leaf_flag) {
+        return ((last >> used_shift) & used_mask) + 1;
+    }
+    v = last;
+    return walk_bits;
 }
 
 bool trie::end() const {
-    return v->L == nullptr;
+    return last & leaf_flag;
 }
 
 unsigned char trie::get() const {
-    return v->val;
+    return last & 0xff;
 }
 
 void trie::init() {
-    v = root;
-}
-
-trie::~trie() {
-    delete root;
-    for (auto c : verts) {
-        delete c;
-    }
+    v = 0;
+    last = 0;
 }
@@ -8,26 +8,46 @@ typedef uint64_t ull;
 #include <vector>
 
 
+// Code trie stored as one flat array of nodes that each cover walk_bits
+// levels: a node is 2^walk_bits 16-bit slots indexed by the next stream
+// bits, first bit lowest. A slot is empty (0), the index of the next node,
+// or a leaf tagged with leaf_flag that holds the symbol and how many of the
+// bits its code used.
 class trie {
 public:
+    static const uint walk_bits = 4;
+
     explicit trie(const std::vector<std::pair<char, ull>>& codes);
 
-    bool step(uint c);
+    // False if two codes overlap, a code is longer than 64 bits or the trie
+    // needs more nodes than a slot can address
+    bool valid() const;
+
+    // Walks the next walk_bits bits and returns how many of them were used:
+    // walk_bits inside the trie, fewer when a code ended (end() then holds),
+    // or 0 if the bits lead nowhere
+    uint step(uint bits);
     bool end() const;
     unsigned char get() const;
     void init();
-    ~trie();
 
 private:
-    struct node {
-        node *L = nullptr, *R = nullptr;
-        unsigned char val = 0;
-    };
-    node *root = new node();
-    node *v = root;
-    void insert(unsigned char len, ull code, unsigned char symbol);
-
-    std::vector<node*> verts;
+    static const uint fanout = 1u << walk_bits;
+    static const uint16_t leaf_flag = 0x8000;
+    // A leaf keeps the bits its code used, less one, in used_bits bits above
+    // the symbol
+    static const uint used_shift = 8;
+    static const uint used_bits = 2;
+    static const uint used_mask = (1u << used_bits) - 1;
+    static_assert(1u << used_bits == walk_bits, "a leaf must hold 1 to walk_bits used bits");
+    static const uint max_nodes = leaf_flag;
+
+    std::vector<uint16_t> slots;
+    uint nodes = 1;
+    uint16_t v = 0, last = 0;
+    bool ok = true;
+
+    bool insert(uint len, ull code, unsigned char symbol);
 };
 
 
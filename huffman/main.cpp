@@ -1,35 +1,198 @@
+#include <cctype>
+#include <cstdint>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "huffman.h"
 
+namespace {
+    // A whole-file mapping, unmapped and closed on destruction
+    struct mapped_file {
+        int fd = -1;
+        void *data = nullptr;
+        size_t size = 0;
+
+        bool map(int prot) {
+            if (size == 0) {
+                return true;
+            }
+            data = mmap(nullptr, size, prot, (prot & PROT_WRITE) ? MAP_SHARED : MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+                return false;
+            }
+            return true;
+        }
+
+        ~mapped_file() {
+            if (data) {
+                munmap(data, size);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+
+    // Whether both paths name an existing file and it is the same one
+    bool same_file(const std::string &a, const std::string &b) {
+        struct stat sa, sb;
+        return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev &&
+               sa.st_ino == sb.st_ino;
+    }
+
+    // Parses a decimal argument of at most max; false on anything else
+    bool parse_number(const std::string &arg, ull max, ull &res) {
+        if (arg.empty() || !isdigit((unsigned char) arg[0])) {
+            return false;
+        }
+        size_t used;
+        try {
+            res = std::stoull(arg, &used);
+        } catch (const std::exception &) {
+            return false;
+        }
+        return used == arg.size() && res <= max;
+    }
+
+    // Compresses or decompresses between two mapped regular files. Returns
+    // false if mapping does not apply (pipes, devices, pre-block formats) so
+    // the caller can fall back to streams.
+    bool run_mapped(const std::string &option, const std::string &source, const std::string &target,
+                    uint threads, uint level, bool &valid) {
+        mapped_file in;
+        struct stat st;
+        in.fd = open(source.c_str(), O_RDONLY);
+        if (in.fd < 0 || fstat(in.fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        in.size = st.st_size;
+        if (!in.map(PROT_READ)) {
+            return false;
+        }
+        auto in_data = (const unsigned char *) in.data;
+
+        mapped_file out;
+        ull raw_size = 0;
+        if (option == "-c" || option == "-C") {
+            out.size = huffman::compress_bound(in.size);
+        } else if (huffman::decompressed_size(in_data, in.size, raw_size)) {
+            out.size = raw_size;
+        } else {
+            return false;
+        }
+        out.fd = open(target.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out.fd < 0 || fstat(out.fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+            ftruncate(out.fd, out.size) != 0 || !out.map(PROT_READ | PROT_WRITE)) {
+            return false;
+        }
+        auto out_data = (unsigned char *) out.data;
+
+        valid = true;
+        if (option == "-c" || option == "-C") {
+            size_t res = huffman::compress(in_data, in.size, out_data, threads, 4, option == "-C", level);
+            munmap(out.data, out.size);
+            out.data = nullptr;
+            valid = (ftruncate(out.fd, res) == 0);
+        } else {
+            valid = huffman::decompress(in_data, in.size, out_data, out.size, threads);
+        }
+        return true;
+    }
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
-        std::cerr << "Usage: <huffman> <-c | -d> <source file> <target file>" << std::endl;
+    // Streams keep up to -B blocks in flight so reading, coding and writing
+    // overlap; -B 0 reads and writes in turn
+    uint threads = 1, level = 0, buffers = 4;
+    ull offset = 0, length = 0;
+    bool valid_args = true;
+    int arg = 1;
+    for (; valid_args && arg + 1 < argc; arg += 2) {
+        std::string flag = argv[arg];
+        if (flag != "-T" && flag != "-L" && flag != "-B") {
+            break;
+        }
+        ull value = 0;
+        valid_args = parse_number(argv[arg + 1], flag == "-L" ? 9 : UINT32_MAX, value);
+        if (valid_args) {
+            (flag == "-T" ? threads : flag == "-L" ? level : buffers) = (uint) value;
+        }
+    }
+    std::string option = (arg < argc ? argv[arg++] : "");
+    if (valid_args && option == "-r") {
+        valid_args = arg + 1 < argc && parse_number(argv[arg], UINT64_MAX, offset) &&
+                     parse_number(argv[arg + 1], UINT64_MAX, length);
+        arg += 2;
+    }
+    if (!valid_args || argc - arg != 2) {
+        std::cerr << "Usage: <huffman> [-T <threads>] [-L <level 0-9>] [-B <buffers>] <-c | -C | -d | -r <offset> <length>> "
+                     "<source file | -> <target file | ->" << std::endl;
         return 0;
     }
+    std::string source = argv[arg];
+    std::string target = argv[arg + 1];
 
-    std::string option = std::string(argv[1]);
-    std::string source = std::string(argv[2]);
-    std::string target = std::string(argv[3]);
-
-    if (option != "-c" && option != "-d") {
+    // -C compresses with per-context code tables
+    if (option != "-c" && option != "-C" && option != "-d" && option != "-r") {
         std::cerr << "invalid option" << std::endl;
         return 0;
     }
 
-    std::ifstream in(source, std::ifstream::binary);
-    std::ofstream out(target, std::ofstream::binary);
+    // Opening the target truncates it, which would destroy the source first
+    if (source != "-" && target != "-" && same_file(source, target)) {
+        std::cerr << "Source and target are the same file" << std::endl;
+        return 0;
+    }
+
+    // A failed decompression leaves no partial target behind
+    if (option != "-r" && source != "-" && target != "-") {
+        bool valid;
+        if (run_mapped(option, source, target, threads, level, valid)) {
+            if (!valid) {
+                std::cerr << (option == "-d" ? "Invalid source file" : "Output error") << std::endl;
+                if (option == "-d") {
+                    unlink(target.c_str());
+                }
+            }
+            return 0;
+        }
+    }
 
-    if (!in.is_open() || !out.is_open()) {
+    std::ios::sync_with_stdio(false);
+    std::ifstream in_file;
+    std::ofstream out_file;
+    if (source != "-") {
+        in_file.open(source, std::ifstream::binary);
+    }
+    if (target != "-") {
+        out_file.open(target, std::ofstream::binary);
+    }
+    std::istream &in = (source == "-" ? std::cin : in_file);
+    std::ostream &out = (target == "-" ? std::cout : out_file);
+
+    if ((source != "-" && !in_file.is_open()) || (target != "-" && !out_file.is_open())) {
         std::cerr << "File opening error" << std::endl;
         return 0;
     }
-    if (option == "-c") {
-        huffman::compress(in, out);
+    bool valid = true;
+    if (option == "-c" || option == "-C") {
+        huffman::compress(in, out, threads, 4, option == "-C", level, buffers);
+    } else if (option == "-r") {
+        valid = huffman::decompress_range(in, offset, length, out);
     } else {
-        if (!huffman::decompress(in, out)) {
-            std::cerr << "Invalid source file" << std::endl;
+        valid = huffman::decompress(in, out, threads, buffers);
+    }
+    if (!valid) {
+        std::cerr << "Invalid source file" << std::endl;
+        if (target != "-") {
+            out_file.close();
+            unlink(target.c_str());
         }
     }
     return 0;